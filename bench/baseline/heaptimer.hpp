@@ -0,0 +1,126 @@
+#ifndef BASELINE_HEAP_TIMER_H
+#define BASELINE_HEAP_TIMER_H
+
+#include <functional>
+#include <chrono>
+#include <vector>
+#include <unordered_map>
+#include <utility>
+
+/*  对比基准：改为时间轮之前的定时器(vector小顶堆 + id到下标的哈希表)
+    只在微基准中与TimerManager对比，逻辑与原实现一致，仅改名以免与现有类冲突
+*/
+namespace baseline {
+
+class HeapTimer {
+public:
+    typedef std::chrono::high_resolution_clock CLOCK;
+    typedef CLOCK::time_point TimeStamp;
+    typedef std::chrono::milliseconds MS;
+    typedef std::function<void()> TimeoutCallBack;
+
+    struct TimerNode {
+        int id;
+        TimeStamp timeExpire;
+        TimeoutCallBack callbackFunc;
+
+        bool operator< (const TimerNode& t) {
+            return timeExpire < t.timeExpire;
+        }
+    };
+
+    HeapTimer() { heapTimer_.reserve(128); };
+    ~HeapTimer() { clear(); };
+
+    void addTimer(int id, int timewait, const TimeoutCallBack& cbfunc) {
+        size_t i;
+        if(ref_.count(id) == 0) {
+            i = heapTimer_.size();
+            ref_[id] = i;
+            heapTimer_.push_back({id, CLOCK::now() + MS(timewait), cbfunc});
+            siftup(i);
+        } else {
+            i = ref_[id];
+            heapTimer_[i].timeExpire = CLOCK::now() + MS(timewait);
+            heapTimer_[i].callbackFunc = cbfunc;
+            siftup(i);
+            siftdown(i);
+        }
+    }
+
+    void handleExpiredTimer() {
+        while(!heapTimer_.empty()) {
+            TimerNode node = heapTimer_.front();
+            if(std::chrono::duration_cast<MS>(node.timeExpire - CLOCK::now()).count() > 0) {
+                break;
+            }
+            node.callbackFunc();
+            pop();
+        }
+    }
+
+    void update(size_t id, int timewait) {
+        int i = ref_[id];
+        heapTimer_[i].timeExpire = CLOCK::now() + MS(timewait);
+        siftdown(i);
+    }
+
+    void pop() { delTimer(0); };
+    void clear() {
+        ref_.clear();
+        heapTimer_.clear();
+    }
+    size_t size() const { return heapTimer_.size(); };
+
+private:
+    void delTimer(size_t i) {
+        size_t n = heapTimer_.size() - 1;
+        swapNode(i, n);
+        ref_.erase(heapTimer_.back().id);
+        heapTimer_.pop_back();
+        if(!heapTimer_.empty() && i < heapTimer_.size()) {
+            siftup(i);
+            siftdown(i);
+        }
+    }
+
+    void siftup(size_t i) {
+        while(i > 0) {
+            size_t j = (i - 1) / 2;
+            if(heapTimer_[j] < heapTimer_[i]) {
+                break;
+            }
+            swapNode(i, j);
+            i = j;
+        }
+    }
+
+    void siftdown(size_t i) {
+        size_t n = heapTimer_.size();
+        size_t j = 2 * i + 1;
+        while(j < n) {
+            if(heapTimer_[i] < heapTimer_[j]) {
+                break;
+            }
+            if((j + 1 < n) && heapTimer_[j + 1] < heapTimer_[j]) {
+                ++j;
+            }
+            swapNode(i, j);
+            i = j;
+            j = 2 * i + 1;
+        }
+    }
+
+    void swapNode(size_t i, size_t j) {
+        std::swap(heapTimer_[i], heapTimer_[j]);
+        ref_[heapTimer_[i].id] = i;
+        ref_[heapTimer_[j].id] = j;
+    }
+
+    std::vector<TimerNode> heapTimer_;
+    std::unordered_map<size_t, size_t> ref_;
+};
+
+}
+
+#endif
\ No newline at end of file
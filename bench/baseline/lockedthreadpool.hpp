@@ -0,0 +1,81 @@
+#ifndef BASELINE_LOCKED_THREAD_POOL_H
+#define BASELINE_LOCKED_THREAD_POOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <functional>
+#include <future>
+#include <memory>
+#include <stdexcept>
+
+/*  对比基准：改为无锁队列之前的线程池(一把互斥锁 + std::function队列)
+    只在微基准中与ThreadPool对比，逻辑与原实现一致，仅改名以免与现有类冲突
+*/
+namespace baseline {
+
+class LockedThreadPool {
+public:
+    LockedThreadPool(size_t threadNum) : isStop(false) {
+        for(size_t i = 0; i < threadNum; i++) {
+            WorkThreads.emplace_back([this] {
+                while(true) {
+                    std::function<void()> task;
+                    {
+                        std::unique_lock<std::mutex> lock(m_mutex);
+                        m_cond.wait(lock, [this] {
+                            return isStop || !tasks.empty();});
+                        if(isStop && tasks.empty()) {
+                            return;
+                        }
+                        task = std::move(tasks.front());
+                        tasks.pop();
+                    }
+                    task();
+                }
+            });
+        }
+    }
+
+    template <typename F, typename... Args>
+    auto enqueue(F &&f, Args &&...args) -> std::future<typename std::result_of<F(Args...)>::type> {
+        using returnType = typename std::result_of<F(Args...)>::type;
+        auto task = std::make_shared<std::packaged_task<returnType()>> (
+            std::bind(std::forward<F>(f), std::forward<Args>(args)...)
+        );
+        std::future<returnType> res = task->get_future();
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if(isStop) {
+                throw std::runtime_error("threadpool already stopped, enqueue failed");
+            }
+            tasks.emplace([task]{(*task)();});
+        }
+        m_cond.notify_one();
+        return res;
+    }
+
+    ~LockedThreadPool() {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            isStop = true;
+        }
+        m_cond.notify_all();
+        for(std::thread &worker : WorkThreads) {
+            worker.join();
+        }
+    }
+
+private:
+    std::vector<std::thread> WorkThreads;
+    std::queue<std::function<void()>> tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    bool isStop;
+};
+
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,206 @@
+#ifndef BASELINE_REGEX_HTTP_REQUEST_H
+#define BASELINE_REGEX_HTTP_REQUEST_H
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <regex>
+#include <assert.h>
+#include "../../include/buffer.hpp"
+
+/*  对比基准：改为状态机之前的请求解析(每行拷贝成string，用std::regex匹配请求行和头部)
+    只在微基准中与HttpRequest对比，逻辑与原实现一致，仅改名以免与现有类冲突
+    原实现按连续缓冲区读取，这里先Pullup可读数据；ConvertHex补上数字字符的返回值(原实现缺少返回，属于未定义行为)
+    原实现不按Content-Length切分请求，无法解析流水线请求，调用方需逐个请求送入
+*/
+namespace baseline {
+
+class RegexHttpRequest {
+public:
+    // 解析状态
+    enum ParseState {
+        RequestLine,    // 请求行
+        Header, // 请求头部
+        Body,   // 请求体
+        Finish, // 完成
+    };
+
+    RegexHttpRequest() {
+        init();
+    }
+    ~RegexHttpRequest() = default;
+
+    void init() {
+        parse_state_ = RequestLine;
+        path_ = method_ = version_ = body_ = "";
+        header_.clear();
+        post_.clear();
+    }
+
+    bool parse(Buffer &buffer) {
+        const char *CRLF = "\r\n";  // 回车换行符
+        if(buffer.readableBytes() <= 0) {
+            return false;
+        }
+        buffer.Pullup(buffer.readableBytes());
+        const char *end = buffer.curReadPtr() + buffer.readableBytes();
+        // buffer中有可读数据&&解析状态未到Finish，就一直解析
+        while(buffer.readableBytes() && parse_state_ != Finish) {
+            // 获取每一行，以\r\n为结束标志，lineEnd指向\r
+            const char* lineEnd = std::search(buffer.curReadPtr(), end, CRLF, CRLF + 2);
+            std::string line(buffer.curReadPtr(), lineEnd);
+            switch (parse_state_)
+            {
+            case RequestLine:
+                if(!ParseRequestLine(line)) {
+                    return false;
+                }
+                ParsePath();
+                break;
+            case Header:
+                ParseHeader(line);
+                if(buffer.readableBytes() <= 2) {
+                    parse_state_ = Finish;
+                }
+                break;
+            case Body:
+                ParseBody(line);
+                break;
+            default:
+                break;
+            }
+            if(lineEnd == end) {
+                break;
+            }
+            buffer.RetrieveUntill(lineEnd + 2);
+        }
+        return true;
+    }
+
+    const std::string &path() const { return path_; };
+    const std::string &method() const { return method_; };
+    const std::string &version() const { return version_; };
+    std::string GetPost(const std::string& key) const {
+        assert(key != "");
+        if(post_.count(key) == 1) {
+            return post_.find(key)->second;
+        }
+        return "";
+    }
+    bool isKeepAlive() const {
+        if(header_.count("Connection") == 1) {
+            return header_.find("Connection")->second == "keep-alive" && version_ == "1.1";
+        }
+        return false;
+    }
+
+private:
+    void ParsePath() {
+        if(path_ == "/") {
+            path_ = "/index.html";
+        } else {
+            for(auto &item : DefaultHtml_()) {
+                if(item == path_) {
+                    path_ += ".html";
+                    break;
+                }
+            }
+        }
+    }
+
+    bool ParseRequestLine(const std::string& line) {
+        std::regex patten("^([^ ]*) ([^ ]*) HTTP/([^ ]*)$");
+        std::smatch subMatch;
+        if(std::regex_match(line, subMatch, patten)) {
+            method_ = subMatch[1];
+            path_ = subMatch[2];
+            version_ = subMatch[3];
+            parse_state_ = Header;
+            return true;
+        }
+        return false;
+    }
+
+    void ParseHeader(const std::string& line) {
+        std::regex patten("^([^:]*): ?(.*)$");
+        std::smatch subMatch;
+        if(regex_match(line, subMatch, patten)) {
+            header_[subMatch[1]] = subMatch[2];
+        } else {
+            // 解析到空行，转为解析请求体
+            parse_state_ = Body;
+        }
+    }
+
+    void ParseBody(const std::string& line) {
+        body_ = line;
+        ParsePost();
+        parse_state_ = Finish;
+    }
+
+    void ParsePost() {
+        if(method_ == "POST" && header_["Content-Type"] == "application/x-www-form-urlencoded") {
+            int n = body_.size();
+            if(n == 0) {
+                return;
+            }
+            std::string key, value;
+            int num = 0, i = 0, j = 0;
+            for(; i < n; i++) {
+                char ch = body_[i];
+                switch (ch)
+                {
+                case '=':
+                    key = body_.substr(j, i - j);
+                    j = i + 1;
+                    break;
+                case '+':
+                    body_[i] = ' ';
+                    break;
+                case '%':
+                    num = ConvertHex(body_[i + 1]) * 16 + ConvertHex(body_[i + 2]);
+                    body_[i + 2] = num % 10 + '0';
+                    body_[i + 1] = num / 10 + '0';
+                    i += 2;
+                    break;
+                case '&':
+                    value = body_.substr(j, i - j);
+                    j = i + 1;
+                    post_[key] = value;
+                    break;
+                default:
+                    break;
+                }
+            }
+            assert(j <= i);
+            // 最后一对key=value，其后没有&分割符
+            if(post_.count(key) == 0 && j < i) {
+                value = body_.substr(j, i - j);
+                post_[key] = value;
+            }
+        }
+    }
+
+    static int ConvertHex(char ch) {
+        if(ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+        if(ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+        return ch - '0';
+    }
+
+    static const std::unordered_set<std::string> &DefaultHtml_() {
+        static const std::unordered_set<std::string> html {
+            "/index", "/register", "/login", "/welcome", "/video", "/picture",
+        };
+        return html;
+    }
+
+    ParseState parse_state_;    // 解析状态
+    std::string method_, path_, version_, body_; // 请求方法，路径，协议版本，请求体
+    std::unordered_map<std::string, std::string> header_;   // 请求头部 <key>:<value>
+    std::unordered_map<std::string, std::string> post_;     // POST请求表单数据
+};
+
+}
+
+#endif
\ No newline at end of file
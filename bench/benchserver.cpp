@@ -0,0 +1,65 @@
+#include "../include/webserver.hpp"
+#include <getopt.h>
+#include <cstring>
+
+/*  压测用的服务器：与main.cpp相同，但参数由命令行给出，便于脚本切换触发模式和线程数
+    资源目录仍为<当前目录>/../resources/，需在仓库的子目录(如bench/)中启动
+    默认不写访问日志，避免压测结果受磁盘影响
+*/
+static void usage(const char *name) {
+    fprintf(stderr,
+        "usage: %s [-p port] [-m trigMode] [-t threadNum] [-r reactorNum] [-i inline] [-b epoll|io_uring] [-l accessLog]\n"
+        "  -p  listen port (1316)\n"
+        "  -m  trigger mode 0-3 (3)\n"
+        "  -t  thread pool size (4)\n"
+        "  -r  reactor threads (4)\n"
+        "  -i  1: run fast requests to completion in the reactor, 0: hand every request to the pool (1)\n"
+        "  -b  event backend (epoll)\n"
+        "  -l  access log path (off)\n", name);
+}
+
+int main(int argc, char *argv[]) {
+    int port = 1316;
+    int trigMode = 3;
+    int threadNum = 4;
+    int reactorNum = 4;
+    bool runInline = true;
+    Poller::Backend backend = Poller::EPOLL;
+    AccessLogOptions accessLogOptions;
+
+    int opt;
+    while((opt = getopt(argc, argv, "p:m:t:r:i:b:l:h")) != -1) {
+        switch (opt)
+        {
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'm':
+            trigMode = atoi(optarg);
+            break;
+        case 't':
+            threadNum = atoi(optarg);
+            break;
+        case 'r':
+            reactorNum = atoi(optarg);
+            break;
+        case 'i':
+            runInline = atoi(optarg) != 0;
+            break;
+        case 'b':
+            backend = strcmp(optarg, "io_uring") == 0 ? Poller::IO_URING : Poller::EPOLL;
+            break;
+        case 'l':
+            accessLogOptions.path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // 压测时所有连接来自同一地址，不限流；准入控制只保留连接数上限
+    WebServer server(port, trigMode, 60000, false, threadNum, reactorNum, 10, runInline, backend,
+        ListenOptions(), AdmissionOptions(), RateLimitOptions(), accessLogOptions);
+    server.Start();
+}
\ No newline at end of file
@@ -0,0 +1,613 @@
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <memory>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <getopt.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "../include/metrics.hpp"
+
+/*  HTTP负载生成器：多线程，每个线程一个epoll，各自管理一部分连接
+    闭环(默认)：每个连接保持pipeline个请求在途，收到一个响应就发出下一个
+    开环(-r)：按固定速率安排请求的计划发送时刻，延迟从计划时刻算起(修正coordinated omission)：
+        服务器变慢时请求在客户端排队，排队的时间也计入延迟，而不是像闭环那样跟着放慢发送
+    长连接(-k 1)或每个请求新建连接(-k 0，Connection: close，延迟包含建立连接)
+    URL从-u给出的列表或-R目录树中的所有文件中均匀随机选取
+    延迟记录在对数分桶的直方图中(与服务器的/metrics相同)，报告吞吐量和p50/p90/p99/p999/max
+*/
+
+struct Config {
+    std::string host = "127.0.0.1";
+    int port = 1316;
+    int threads = 4;
+    int connections = 64;
+    double duration = 10;   // 测量时长(s)
+    double warmup = 1;  // 预热时长(s)，不计入结果
+    int pipeline = 1;
+    bool keepAlive = true;
+    double rate = 0;    // 开环时的总请求速率(req/s)，0表示闭环
+    bool json = false;
+    std::vector<std::string> urls;
+};
+
+// 一个线程的统计
+struct Stats {
+    Histogram latency;  // ns
+    uint64_t completed = 0;
+    uint64_t bytes = 0;
+    uint64_t errors = 0;
+    uint64_t non2xx = 0;    // 2xx、3xx以外的响应
+    uint64_t maxNS = 0;
+};
+
+class Worker {
+public:
+    Worker(const Config &config, int connections, double rate, uint64_t seed)
+        : config_(config), rate_(rate), seed_(seed | 1), epfd_(epoll_create1(EPOLL_CLOEXEC)), 
+        timerfd_(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) {
+        conns_.resize(connections);
+        std::string host = config_.host + ":" + std::to_string(config_.port);
+        for(const std::string &url : config_.urls) {
+            requests_.push_back("GET " + url + " HTTP/1.1\r\nHost: " + host +
+                (config_.keepAlive ? "\r\nConnection: keep-alive\r\n\r\n" : "\r\nConnection: close\r\n\r\n"));
+        }
+        inet_pton(AF_INET, config_.host.c_str(), &addr_.sin_addr);
+        addr_.sin_family = AF_INET;
+        addr_.sin_port = htons(config_.port);
+    }
+    ~Worker() {
+        for(Conn &conn : conns_) {
+            if(conn.fd >= 0) {
+                close(conn.fd);
+            }
+        }
+        close(timerfd_);
+        close(epfd_);
+    }
+
+    void run(uint64_t begin, uint64_t measureBegin, uint64_t end);
+    const Stats &stats() const { return stats_; };
+
+private:
+    struct Conn {
+        int fd = -1;
+        uint32_t gen = 0;   // 每次新建连接加一，丢弃旧连接残留的事件
+        bool connected = false;
+        std::string out;    // 待发送的请求
+        size_t outPos = 0;
+        std::deque<uint64_t> inflight;  // 在途请求的开始时刻(开环时为计划时刻)
+        std::string head;   // 尚不完整的响应头
+        size_t bodyLeft = 0;    // 当前响应体还需接收的字节数
+        int status = 0;
+        bool closeAfter = false;    // 响应带Connection: close
+        size_t respBytes = 0;
+    };
+
+    bool closedLoop() const { return rate_ <= 0; };
+    bool canTake_(const Conn &conn) const {
+        return config_.keepAlive ? conn.inflight.size() < (size_t)config_.pipeline : conn.fd < 0;
+    }
+    uint64_t random_() {
+        // xorshift64
+        seed_ ^= seed_ << 13;
+        seed_ ^= seed_ >> 7;
+        seed_ ^= seed_ << 17;
+        return seed_;
+    }
+
+    bool connect_(Conn &conn);
+    void close_(Conn &conn);
+    void issue_(Conn &conn, uint64_t start);   // 发出一个请求
+    void flush_(Conn &conn);
+    void fail_(Conn &conn); // 连接出错：在途请求计为错误，闭环时重新发出
+    void refill_(Conn &conn, uint64_t now);    // 闭环：补足在途请求
+    void onEvent_(Conn &conn, uint32_t events);
+    void onData_(Conn &conn, const char *data, size_t len);
+    bool parseHead_(Conn &conn);
+    void finish_(Conn &conn);   // 一个响应接收完毕
+    void dispatch_();   // 开环：把到期的请求分给空闲的连接
+    void arm_(uint64_t when);   // 开环：timerfd在when(ns)到期，精度不受epoll_wait的毫秒超时限制
+
+    const Config &config_;
+    double rate_;   // 本线程的请求速率
+    uint64_t seed_;
+    int epfd_;
+    int timerfd_;
+    struct sockaddr_in addr_ = {};
+    std::vector<Conn> conns_;
+    std::vector<std::string> requests_;
+    std::deque<uint64_t> backlog_;  // 开环：已到计划时刻但还没有连接可用的请求
+    size_t next_ = 0;   // 开环：下一个检查的连接
+    uint64_t now_ = 0;
+    uint64_t measureBegin_ = 0;
+    uint64_t end_ = 0;
+    Stats stats_;
+
+    static const uint64_t TIMER_TAG = ~(uint64_t)0; // timerfd在epoll中的标记
+};
+
+bool Worker::connect_(Conn &conn) {
+    conn.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(conn.fd < 0) {
+        return false;
+    }
+    int one = 1;
+    setsockopt(conn.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    int ret = connect(conn.fd, (struct sockaddr *)&addr_, sizeof(addr_));
+    if(ret < 0 && errno != EINPROGRESS) {
+        close(conn.fd);
+        conn.fd = -1;
+        return false;
+    }
+    conn.gen++;
+    conn.connected = ret == 0;
+    struct epoll_event event = {};
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.u64 = (uint64_t)conn.gen << 32 | (&conn - conns_.data());
+    epoll_ctl(epfd_, EPOLL_CTL_ADD, conn.fd, &event);
+    return true;
+}
+
+void Worker::close_(Conn &conn) {
+    if(conn.fd >= 0) {
+        close(conn.fd);
+    }
+    conn.fd = -1;
+    conn.connected = false;
+    conn.out.clear();
+    conn.outPos = 0;
+    conn.inflight.clear();
+    conn.head.clear();
+    conn.bodyLeft = 0;
+}
+
+void Worker::issue_(Conn &conn, uint64_t start) {
+    if(conn.fd < 0 && !connect_(conn)) {
+        stats_.errors++;
+        return;
+    }
+    conn.out += requests_[requests_.size() > 1 ? random_() % requests_.size() : 0];
+    conn.inflight.push_back(start);
+    if(conn.connected) {
+        flush_(conn);
+    }
+}
+
+void Worker::flush_(Conn &conn) {
+    while(conn.outPos < conn.out.size()) {
+        ssize_t len = write(conn.fd, conn.out.data() + conn.outPos, conn.out.size() - conn.outPos);
+        if(len < 0) {
+            if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                return;
+            }
+            if(errno == EINTR) {
+                continue;
+            }
+            fail_(conn);
+            return;
+        }
+        conn.outPos += len;
+    }
+    conn.out.clear();
+    conn.outPos = 0;
+}
+
+void Worker::fail_(Conn &conn) {
+    stats_.errors += std::max<size_t>(conn.inflight.size(), 1);
+    close_(conn);
+    if(closedLoop()) {
+        refill_(conn, now_);
+    }
+}
+
+void Worker::refill_(Conn &conn, uint64_t now) {
+    if(now >= end_) {
+        return;
+    }
+    while(canTake_(conn)) {
+        issue_(conn, now);
+        if(conn.fd < 0) {
+            // 建立连接失败
+            return;
+        }
+    }
+}
+
+bool Worker::parseHead_(Conn &conn) {
+    const std::string &head = conn.head;
+    if(head.compare(0, 5, "HTTP/") != 0 || head.size() < 12) {
+        return false;
+    }
+    conn.status = atoi(head.c_str() + 9);
+    conn.bodyLeft = 0;
+    conn.closeAfter = !config_.keepAlive;
+    // 逐行查找Content-Length和Connection(不区分大小写)
+    size_t pos = head.find("\r\n");
+    while(pos != std::string::npos && pos + 2 < head.size()) {
+        const char *line = head.c_str() + pos + 2;
+        if(strncasecmp(line, "Content-Length:", 15) == 0) {
+            conn.bodyLeft = strtoull(line + 15, nullptr, 10);
+        } else if(strncasecmp(line, "Connection:", 11) == 0) {
+            const char *value = line + 11;
+            while(*value == ' ') {
+                value++;
+            }
+            conn.closeAfter = strncasecmp(value, "close", 5) == 0;
+        }
+        pos = head.find("\r\n", pos + 2);
+    }
+    return true;
+}
+
+void Worker::onData_(Conn &conn, const char *data, size_t len) {
+    int fd = conn.fd;
+    while(len > 0 && conn.fd == fd) {
+        if(conn.bodyLeft > 0) {
+            // 响应体只计数，不保存
+            size_t n = std::min(len, conn.bodyLeft);
+            conn.bodyLeft -= n;
+            conn.respBytes += n;
+            data += n;
+            len -= n;
+            if(conn.bodyLeft == 0) {
+                finish_(conn);
+            }
+            continue;
+        }
+        size_t old = conn.head.size();
+        conn.head.append(data, len);
+        size_t end = conn.head.find("\r\n\r\n", old >= 3 ? old - 3 : 0);
+        if(end == std::string::npos) {
+            if(conn.head.size() > 64 * 1024) {
+                fail_(conn);
+            }
+            return;
+        }
+        size_t used = end + 4 - old;
+        data += used;
+        len -= used;
+        conn.head.resize(end + 4);
+        conn.respBytes = conn.head.size();
+        if(conn.inflight.empty() || !parseHead_(conn)) {
+            // 多余或无法解析的响应
+            fail_(conn);
+            return;
+        }
+        conn.head.clear();
+        if(conn.bodyLeft == 0) {
+            finish_(conn);
+        }
+    }
+}
+
+void Worker::finish_(Conn &conn) {
+    uint64_t start = conn.inflight.front();
+    conn.inflight.pop_front();
+    if(now_ >= measureBegin_ && now_ < end_) {
+        uint64_t latency = now_ > start ? now_ - start : 0;
+        stats_.latency.record(latency);
+        stats_.maxNS = std::max(stats_.maxNS, latency);
+        stats_.completed++;
+        stats_.bytes += conn.respBytes;
+        if(conn.status < 200 || conn.status >= 400) {
+            stats_.non2xx++;
+        }
+    }
+    if(conn.closeAfter) {
+        if(!conn.inflight.empty()) {
+            // 服务器在流水线中途关闭连接，其余的请求不会有响应
+            stats_.errors += conn.inflight.size();
+        }
+        close_(conn);
+    }
+    if(closedLoop()) {
+        refill_(conn, now_);
+    }
+}
+
+void Worker::onEvent_(Conn &conn, uint32_t events) {
+    if(events & EPOLLERR) {
+        fail_(conn);
+        return;
+    }
+    if(!conn.connected && (events & EPOLLOUT)) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if(err != 0) {
+            fail_(conn);
+            return;
+        }
+        conn.connected = true;
+    }
+    if(events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) {
+        static thread_local char buf[64 * 1024];
+        int fd = conn.fd;
+        while(conn.fd == fd) {
+            ssize_t len = read(fd, buf, sizeof(buf));
+            if(len > 0) {
+                onData_(conn, buf, len);
+                continue;
+            }
+            if(len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            }
+            if(len < 0 && errno == EINTR) {
+                continue;
+            }
+            // 对端关闭：有在途请求则计为错误
+            if(conn.inflight.empty()) {
+                close_(conn);
+                if(closedLoop()) {
+                    refill_(conn, now_);
+                }
+            } else {
+                fail_(conn);
+            }
+            return;
+        }
+        if(conn.fd != fd) {
+            return;
+        }
+    }
+    if(conn.connected && !conn.out.empty()) {
+        flush_(conn);
+    }
+}
+
+void Worker::dispatch_() {
+    size_t n = conns_.size();
+    while(!backlog_.empty()) {
+        size_t i = 0;
+        while(i < n && !canTake_(conns_[next_])) {
+            next_ = (next_ + 1) % n;
+            i++;
+        }
+        if(i == n) {
+            // 所有连接都忙，请求留在backlog中，排队时间计入延迟
+            return;
+        }
+        Conn &conn = conns_[next_];
+        next_ = (next_ + 1) % n;
+        issue_(conn, backlog_.front());
+        backlog_.pop_front();
+    }
+}
+
+void Worker::arm_(uint64_t when) {
+    struct itimerspec spec = {};
+    spec.it_value.tv_sec = when / 1000000000;
+    spec.it_value.tv_nsec = when % 1000000000;
+    timerfd_settime(timerfd_, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
+
+void Worker::run(uint64_t begin, uint64_t measureBegin, uint64_t end) {
+    measureBegin_ = measureBegin;
+    end_ = end;
+    now_ = Metrics::now();
+    uint64_t interval = closedLoop() ? 0 : (uint64_t)(1e9 / rate_);
+    uint64_t nextSend = begin + (interval > 0 ? random_() % interval : 0);  // 各线程错开
+    if(!closedLoop()) {
+        arm_(nextSend);
+    }
+    if(closedLoop()) {
+        for(Conn &conn : conns_) {
+            refill_(conn, now_);
+        }
+    } else {
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.u64 = TIMER_TAG;
+        epoll_ctl(epfd_, EPOLL_CTL_ADD, timerfd_, &event);
+        if(config_.keepAlive) {
+            // 开环长连接：预先建立连接
+            for(Conn &conn : conns_) {
+                connect_(conn);
+            }
+        }
+    }
+    struct epoll_event events[256];
+    while(now_ < end_) {
+        if(!closedLoop()) {
+            if(nextSend <= now_) {
+                while(nextSend <= now_) {
+                    backlog_.push_back(nextSend);
+                    nextSend += interval;
+                }
+                arm_(nextSend);
+            }
+            dispatch_();
+        }
+        int n = epoll_wait(epfd_, events, 256, 100);
+        now_ = Metrics::now();
+        for(int i = 0; i < n; i++) {
+            if(events[i].data.u64 == TIMER_TAG) {
+                uint64_t expirations;
+                while(read(timerfd_, &expirations, sizeof(expirations)) > 0) {}
+                continue;
+            }
+            Conn &conn = conns_[(uint32_t)events[i].data.u64];
+            if(conn.fd < 0 || conn.gen != events[i].data.u64 >> 32) {
+                continue;
+            }
+            onEvent_(conn, events[i].events);
+        }
+    }
+}
+
+// 递归收集目录下的所有文件，作为以/开头的URL
+static void collectUrls(const std::string &root, const std::string &rel, std::vector<std::string> &urls) {
+    DIR *dir = opendir((root + rel).c_str());
+    if(!dir) {
+        return;
+    }
+    while(struct dirent *entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if(name == "." || name == "..") {
+            continue;
+        }
+        std::string path = rel + "/" + name;
+        struct stat st;
+        if(stat((root + path).c_str(), &st) != 0) {
+            continue;
+        }
+        if(S_ISDIR(st.st_mode)) {
+            collectUrls(root, path, urls);
+        } else if(S_ISREG(st.st_mode)) {
+            urls.push_back(path);
+        }
+    }
+    closedir(dir);
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  -H host         server address (127.0.0.1)\n"
+        "  -p port         server port (1316)\n"
+        "  -t threads      client threads (4)\n"
+        "  -c conns        total connections (64)\n"
+        "  -d seconds      measured duration (10)\n"
+        "  -w seconds      warmup, not measured (1)\n"
+        "  -P depth        pipelined requests per connection (1)\n"
+        "  -k 0|1          1: keep-alive, 0: new connection per request (1)\n"
+        "  -r rate         open loop at a fixed total rate (req/s), latency from the intended send time;\n"
+        "                  0: closed loop (0)\n"
+        "  -u url          request url, may repeat\n"
+        "  -R dir          request every file under dir, picked uniformly at random\n"
+        "  -j              print a JSON summary\n", name);
+}
+
+int main(int argc, char *argv[]) {
+    Config config;
+    int opt;
+    while((opt = getopt(argc, argv, "H:p:t:c:d:w:P:k:r:u:R:jh")) != -1) {
+        switch (opt)
+        {
+        case 'H':
+            config.host = optarg;
+            break;
+        case 'p':
+            config.port = atoi(optarg);
+            break;
+        case 't':
+            config.threads = atoi(optarg);
+            break;
+        case 'c':
+            config.connections = atoi(optarg);
+            break;
+        case 'd':
+            config.duration = atof(optarg);
+            break;
+        case 'w':
+            config.warmup = atof(optarg);
+            break;
+        case 'P':
+            config.pipeline = atoi(optarg);
+            break;
+        case 'k':
+            config.keepAlive = atoi(optarg) != 0;
+            break;
+        case 'r':
+            config.rate = atof(optarg);
+            break;
+        case 'u':
+            config.urls.push_back(optarg);
+            break;
+        case 'R':
+            collectUrls(optarg, "", config.urls);
+            break;
+        case 'j':
+            config.json = true;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if(config.urls.empty()) {
+        config.urls.push_back("/index.html");
+    }
+    std::sort(config.urls.begin(), config.urls.end());
+    config.threads = std::max(1, std::min(config.threads, config.connections));
+    if(!config.keepAlive) {
+        // 每个请求一个连接，不能流水线
+        config.pipeline = 1;
+    }
+    config.pipeline = std::max(1, config.pipeline);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    for(int i = 0; i < config.threads; i++) {
+        int conns = config.connections / config.threads + (i < config.connections % config.threads ? 1 : 0);
+        workers.emplace_back(new Worker(config, conns, config.rate / config.threads, 0x9E3779B97F4A7C15ULL * (i + 1)));
+    }
+    uint64_t begin = Metrics::now();
+    uint64_t measureBegin = begin + (uint64_t)(config.warmup * 1e9);
+    uint64_t end = measureBegin + (uint64_t)(config.duration * 1e9);
+    std::vector<std::thread> threads;
+    for(auto &worker : workers) {
+        threads.emplace_back([&worker, begin, measureBegin, end] { worker->run(begin, measureBegin, end); });
+    }
+    for(std::thread &thread : threads) {
+        thread.join();
+    }
+
+    Histogram::Snapshot latency;
+    Stats total;
+    for(auto &worker : workers) {
+        const Stats &stats = worker->stats();
+        stats.latency.mergeTo(latency);
+        total.completed += stats.completed;
+        total.bytes += stats.bytes;
+        total.errors += stats.errors;
+        total.non2xx += stats.non2xx;
+        total.maxNS = std::max(total.maxNS, stats.maxNS);
+    }
+    double rps = total.completed / config.duration;
+    double mbps = total.bytes / config.duration / (1 << 20);
+    double mean = latency.count ? latency.sum / 1e3 / latency.count : 0;
+    // 分位数取所在桶的上界(us)，不超过最大值
+    double max = total.maxNS / 1e3;
+    double p50 = std::min(latency.quantile(0.5) / 1e3, max);
+    double p90 = std::min(latency.quantile(0.9) / 1e3, max);
+    double p99 = std::min(latency.quantile(0.99) / 1e3, max);
+    double p999 = std::min(latency.quantile(0.999) / 1e3, max);
+
+    if(config.json) {
+        printf("{\"threads\": %d, \"connections\": %d, \"pipeline\": %d, \"keepalive\": %s, \"rate\": %.0f, "
+            "\"duration\": %.1f, \"urls\": %zu, \"requests\": %llu, \"rps\": %.1f, \"mbps\": %.2f, "
+            "\"errors\": %llu, \"non2xx\": %llu, \"mean_us\": %.1f, \"p50_us\": %.1f, \"p90_us\": %.1f, "
+            "\"p99_us\": %.1f, \"p999_us\": %.1f, \"max_us\": %.1f}\n",
+            config.threads, config.connections, config.pipeline, config.keepAlive ? "true" : "false", config.rate,
+            config.duration, config.urls.size(), (unsigned long long)total.completed, rps, mbps,
+            (unsigned long long)total.errors, (unsigned long long)total.non2xx, mean, p50, p90, p99, p999, max);
+        return 0;
+    }
+    printf("%s loop, %s, %d threads, %d connections, pipeline %d, %zu urls, %.1fs\n",
+        config.rate > 0 ? "open" : "closed", config.keepAlive ? "keep-alive" : "close",
+        config.threads, config.connections, config.pipeline, config.urls.size(), config.duration);
+    if(config.rate > 0) {
+        printf("  target rate:  %.0f req/s\n", config.rate);
+    }
+    printf("  requests:     %llu (%.1f req/s, %.2f MB/s)\n", (unsigned long long)total.completed, rps, mbps);
+    printf("  errors:       %llu, non-2xx/3xx: %llu\n", (unsigned long long)total.errors, (unsigned long long)total.non2xx);
+    printf("  latency(us):  mean %.1f  p50 %.1f  p90 %.1f  p99 %.1f  p999 %.1f  max %.1f\n",
+        mean, p50, p90, p99, p999, max);
+    return 0;
+}
\ No newline at end of file
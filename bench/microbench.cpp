@@ -0,0 +1,793 @@
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <random>
+#include <algorithm>
+#include <functional>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include "../include/buffer.hpp"
+#include "../include/httprequest.hpp"
+#include "../include/httpresponse.hpp"
+#include "../include/filecache.hpp"
+#include "../include/timer.hpp"
+#include "../include/threadpool.hpp"
+#include "../include/ratelimit.hpp"
+#include "../include/metrics.hpp"
+#include "../include/accesslog.hpp"
+#include "baseline/heaptimer.hpp"
+#include "baseline/lockedthreadpool.hpp"
+#include "baseline/regexhttprequest.hpp"
+
+/*  微基准：不经过网络，直接测量热路径上各组件单次操作的耗时
+    buffer：Append、链尾挂块扩容、ReadFd；parse：状态机与旧版正则解析器在几种典型请求报文上的对比；response：缓存命中/未命中/404
+    timer：时间轮与旧版堆定时器在1万~100万个定时器下的添加、刷新、到期处理
+    pool：无锁线程池与旧版加锁线程池的吞吐和派发延迟(投递到开始执行)；ratelimit、metrics、accesslog：每请求的附加开销
+    重复执行的基准自动确定迭代次数，重复repeats轮取每次操作耗时的中位数
+    结果以JSON输出到标准输出(或-o指定的文件)，可读的表格输出到标准错误
+*/
+
+// 阻止编译器把结果未被使用的计算优化掉
+static void keep(const void *p) {
+    asm volatile("" : : "g"(p) : "memory");
+}
+
+struct Result {
+    std::string name;
+    uint64_t iterations;    // 计入统计的操作次数
+    double nsPerOp;
+    double bytesPerOp;  // 每次操作处理的字节数，0表示不适用
+    double p99NS;   // 派发延迟的p99，小于0表示不适用
+};
+
+class Bench {
+public:
+    Bench(const std::string &filter, int minMS, int repeats)
+        : filter_(filter), minNS_(minMS * 1e6), repeats_(std::max(repeats, 1)) {
+        fprintf(stderr, "%-48s %14s %12s %14s %12s\n", "benchmark", "iterations", "ns/op", "ops/s", "MB/s|p99 ns");
+    }
+
+    // 名字包含过滤串(为空时全选)
+    bool selected(const std::string &name) const {
+        return filter_.empty() || name.find(filter_) != std::string::npos;
+    }
+    int repeats() const { return repeats_; };
+
+    /*  body(n)连续执行n次操作
+        n从1开始按已测时间放大，直到一轮不短于minNS_/repeats_；再以同样的n重复，取每次操作耗时的中位数
+    */
+    template <typename F>
+    void run(const std::string &name, F body, double bytesPerOp = 0) {
+        if(!selected(name)) {
+            return;
+        }
+        double target = minNS_ / repeats_;
+        uint64_t n = 1;
+        double ns = time_(body, n);
+        while(ns < target) {
+            // 按比例估计所需次数，一次最多放大100倍
+            double scale = ns > 0 ? std::min(target * 1.2 / ns, 100.0) : 100.0;
+            n = std::max(n + 1, (uint64_t)(n * scale));
+            ns = time_(body, n);
+        }
+        std::vector<double> samples(1, ns / n);
+        for(int i = 1; i < repeats_; i++) {
+            samples.push_back(time_(body, n) / n);
+        }
+        add({name, n * repeats_, median_(samples), bytesPerOp, -1});
+    }
+
+    /*  一次性的基准(如在N个定时器上各操作一次)：once()返回本轮的操作次数和耗时，准备工作不计时
+        重复repeats_轮，取每次操作耗时的中位数
+    */
+    void runOnce(const std::string &name, std::function<std::pair<uint64_t, double>()> once) {
+        if(!selected(name)) {
+            return;
+        }
+        std::vector<double> samples;
+        uint64_t total = 0;
+        for(int i = 0; i < repeats_; i++) {
+            std::pair<uint64_t, double> r = once();
+            total += r.first;
+            samples.push_back(r.second / r.first);
+        }
+        add({name, total, median_(samples), 0, -1});
+    }
+
+    void add(const Result &result) {
+        results_.push_back(result);
+        double extra = -1;
+        if(result.bytesPerOp > 0) {
+            extra = result.bytesPerOp / result.nsPerOp * 1e3;  // MB/s
+        } else if(result.p99NS >= 0) {
+            extra = result.p99NS;
+        }
+        fprintf(stderr, "%-48s %14llu %12.1f %14.0f %12s\n", result.name.c_str(),
+            (unsigned long long)result.iterations, result.nsPerOp, 1e9 / result.nsPerOp,
+            extra >= 0 ? std::to_string((long long)extra).c_str() : "-");
+    }
+
+    void writeJson(FILE *out, int minMS) const {
+        fprintf(out, "{\n  \"benchmark\": \"microbench\",\n  \"min_time_ms\": %d,\n  \"repeats\": %d,\n"
+            "  \"hardware_threads\": %u,\n  \"results\": [\n", minMS, repeats_, std::thread::hardware_concurrency());
+        for(size_t i = 0; i < results_.size(); i++) {
+            const Result &r = results_[i];
+            fprintf(out, "    {\"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.3f, \"ops_per_sec\": %.1f",
+                r.name.c_str(), (unsigned long long)r.iterations, r.nsPerOp, 1e9 / r.nsPerOp);
+            if(r.bytesPerOp > 0) {
+                fprintf(out, ", \"bytes_per_sec\": %.0f", r.bytesPerOp / r.nsPerOp * 1e9);
+            }
+            if(r.p99NS >= 0) {
+                fprintf(out, ", \"p99_ns\": %.0f", r.p99NS);
+            }
+            fprintf(out, "}%s\n", i + 1 < results_.size() ? "," : "");
+        }
+        fprintf(out, "  ]\n}\n");
+    }
+
+private:
+    template <typename F>
+    static double time_(F &body, uint64_t n) {
+        uint64_t start = Metrics::now();
+        body(n);
+        return (double)(Metrics::now() - start);
+    }
+    static double median_(std::vector<double> samples) {
+        std::sort(samples.begin(), samples.end());
+        return samples[samples.size() / 2];
+    }
+
+    std::string filter_;
+    double minNS_;  // 每个基准的总测量时长
+    int repeats_;
+    std::vector<Result> results_;
+};
+
+/* ---------------- Buffer ---------------- */
+
+static void benchBuffer(Bench &bench) {
+    std::string data(16 << 10, 'x');
+    for(size_t len : {64, 1024, 16 << 10}) {
+        bench.run("buffer/append_" + std::to_string(len) + "B", [&](uint64_t n) {
+            Buffer buffer;
+            for(uint64_t i = 0; i < n; i++) {
+                buffer.Append(data.data(), len);
+                if(buffer.readableBytes() >= (1 << 20)) {
+                    buffer.RetrieveAll();
+                }
+            }
+            keep(&buffer);
+        }, len);
+    }
+    // 从空缓冲区写到1MB：每4KB在链尾挂一个新块(对应连续数组实现中的MakeSpace扩容)
+    bench.run("buffer/grow_to_1MB", [&](uint64_t n) {
+        for(uint64_t i = 0; i < n; i++) {
+            Buffer buffer;
+            for(int k = 0; k < 256; k++) {
+                buffer.Append(data.data(), 4096);
+            }
+            keep(&buffer);
+        }
+    }, 1 << 20);
+    // 直接写入尾块：EnsureWriteable + UpdateWritePtr(如响应头的格式化)
+    bench.run("buffer/ensure_writeable_256B", [&](uint64_t n) {
+        Buffer buffer;
+        for(uint64_t i = 0; i < n; i++) {
+            buffer.EnsureWriteable(256);
+            memcpy(buffer.curWritePtr(), data.data(), 256);
+            buffer.UpdateWritePtr(256);
+            if(buffer.readableBytes() >= (1 << 20)) {
+                buffer.RetrieveAll();
+            }
+        }
+        keep(&buffer);
+    }, 256);
+    // 从管道读：每次操作包含一次write和一次ReadFd(readv)
+    int fds[2];
+    if(pipe(fds) == 0) {
+        for(size_t len : {1024, 16 << 10}) {
+            bench.run("buffer/readfd_" + std::to_string(len) + "B", [&](uint64_t n) {
+                Buffer buffer;
+                int err = 0;
+                for(uint64_t i = 0; i < n; i++) {
+                    if(write(fds[1], data.data(), len) != (ssize_t)len) {
+                        fprintf(stderr, "pipe write failed\n");
+                        exit(1);
+                    }
+                    // 一次ReadFd读到的可能少于len(受新块数限制)，读完为止
+                    for(size_t got = 0; got < len; ) {
+                        ssize_t r = buffer.ReadFd(fds[0], &err);
+                        if(r <= 0) {
+                            fprintf(stderr, "pipe read failed\n");
+                            exit(1);
+                        }
+                        got += r;
+                    }
+                    buffer.RetrieveAll();
+                }
+            }, len);
+        }
+        close(fds[0]);
+        close(fds[1]);
+    }
+}
+
+/* ---------------- HttpRequest::parse ---------------- */
+
+static const char *CURL_REQUEST =
+    "GET /index.html HTTP/1.1\r\n"
+    "Host: localhost:1316\r\n"
+    "User-Agent: curl/7.81.0\r\n"
+    "Accept: */*\r\n"
+    "\r\n";
+
+static const char *BROWSER_REQUEST =
+    "GET /css/bootstrap.min.css HTTP/1.1\r\n"
+    "Host: localhost:1316\r\n"
+    "Connection: keep-alive\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"118\", \"Google Chrome\";v=\"118\", \"Not=A?Brand\";v=\"99\"\r\n"
+    "sec-ch-ua-mobile: ?0\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/118.0.0.0 Safari/537.36\r\n"
+    "sec-ch-ua-platform: \"Linux\"\r\n"
+    "Accept: text/css,*/*;q=0.1\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "Sec-Fetch-Dest: style\r\n"
+    "Referer: http://localhost:1316/index.html\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+    "Cookie: session=8f14e45fceea167a5a36dedd4bea2543; theme=dark\r\n"
+    "\r\n";
+
+static const char *POST_REQUEST =
+    "POST /login HTTP/1.1\r\n"
+    "Host: localhost:1316\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 Firefox/118.0\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+    "Content-Type: application/x-www-form-urlencoded\r\n"
+    "Content-Length: 40\r\n"
+    "Origin: http://localhost:1316\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n"
+    "username=hou+chen&password=p%40ss%21w0rd";
+
+// 解析缓冲区中的全部请求，返回请求数；语料有误时直接退出，避免测到错误路径
+static int parseAll(HttpRequest &request, Buffer &buffer) {
+    int count = 0;
+    while(buffer.readableBytes() > 0) {
+        request.init();
+        if(request.parse(buffer) != HttpRequest::Complete) {
+            fprintf(stderr, "corpus did not parse as a complete request\n");
+            exit(1);
+        }
+        count++;
+    }
+    return count;
+}
+
+// 对比基准的解析器逐个送入请求：原实现不能在一个缓冲区中切分多个请求
+static void parseRegex(baseline::RegexHttpRequest &request, Buffer &buffer) {
+    request.init();
+    if(!request.parse(buffer) || request.method().empty()) {
+        fprintf(stderr, "corpus did not parse with the regex parser\n");
+        exit(1);
+    }
+    buffer.RetrieveAll();   // 请求体留在缓冲区中，原实现由上层丢弃
+}
+
+static void benchParse(Bench &bench) {
+    struct Corpus {
+        const char *name;
+        const char *request;
+        int count;  // 连续发送的请求数
+    };
+    const Corpus corpora[] = {
+        {"curl", CURL_REQUEST, 1},
+        {"browser", BROWSER_REQUEST, 1},
+        {"post_form", POST_REQUEST, 1},
+        {"pipelined_x16", CURL_REQUEST, 16},
+    };
+    for(const auto &corpus : corpora) {
+        std::string raw;
+        for(int i = 0; i < corpus.count; i++) {
+            raw += corpus.request;
+        }
+        bench.run(std::string("parse/") + corpus.name, [&](uint64_t n) {
+            HttpRequest request;
+            Buffer buffer;
+            for(uint64_t i = 0; i < n; i++) {
+                buffer.Append(raw);
+                parseAll(request, buffer);
+            }
+            keep(&request);
+        }, raw.size());
+        // 同一语料上的原正则解析器
+        bench.run(std::string("parse/regex_") + corpus.name, [&](uint64_t n) {
+            baseline::RegexHttpRequest request;
+            Buffer buffer;
+            for(uint64_t i = 0; i < n; i++) {
+                for(int j = 0; j < corpus.count; j++) {
+                    buffer.Append(corpus.request);
+                    parseRegex(request, buffer);
+                }
+            }
+            keep(&request);
+        }, raw.size());
+    }
+}
+
+/* ---------------- HttpResponse::makeResponse ---------------- */
+
+static void benchResponse(Bench &bench, const std::string &srcDir) {
+    HttpRequest curl, browser;
+    Buffer buffer;
+    buffer.Append(CURL_REQUEST);
+    parseAll(curl, buffer);
+    buffer.Append(BROWSER_REQUEST);
+    parseAll(browser, buffer);
+
+    struct Case {
+        const char *name;
+        const HttpRequest *request;
+        std::string path;
+        bool uncached;  // 每次操作前清空FileCache
+    };
+    const Case cases[] = {
+        {"response/cached_html", &curl, "/index.html", false},
+        {"response/cached_gzip_css", &browser, "/css/bootstrap.min.css", false},
+        {"response/cached_jpg_100KB", &curl, "/images/instagram-image4.jpg", false},
+        {"response/uncached_html", &curl, "/index.html", true},
+        {"response/not_found", &curl, "/missing.html", false},
+    };
+    for(const Case &c : cases) {
+        if(!bench.selected(c.name)) {
+            continue;
+        }
+        HttpResponse response;
+        Buffer out;
+        auto once = [&] {
+            if(c.uncached) {
+                FileCache::instance().clear();
+            }
+            std::string path = c.path;
+            response.init(srcDir, path, true, 200, c.request);
+            response.makeResponse(out);
+            out.RetrieveAll();
+            response.unmapFile();
+        };
+        // 预热：gzip缓存可能在后台压缩，先等压缩结果就绪
+        once();
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        once();
+        bench.run(c.name, [&](uint64_t n) {
+            for(uint64_t i = 0; i < n; i++) {
+                once();
+            }
+        });
+    }
+    FileCache::instance().clear();
+}
+
+/* ---------------- 定时器：时间轮 vs 堆 ---------------- */
+
+static void benchTimer(Bench &bench, size_t maxTimers) {
+    const int EXPIRE_SPREAD_MS = 50;    // 到期测试中定时器的时长分布在[0, 50]ms
+    for(size_t count = 10000; count <= maxTimers; count *= 10) {
+        std::string suffix = "/" + std::to_string(count / 1000) + "k";
+        std::mt19937 rng(count);
+        std::vector<int> timeouts(count);
+        std::vector<int> shortTimeouts(count);
+        for(size_t i = 0; i < count; i++) {
+            timeouts[i] = 1 + rng() % 60000;
+            shortTimeouts[i] = rng() % (EXPIRE_SPREAD_MS + 1);
+        }
+        uint64_t fired = 0;
+        TimeoutCallBack callback = [&fired] { fired++; };
+
+        bench.runOnce("timer/wheel_add" + suffix, [&] {
+            TimerManager timer;
+            std::unique_ptr<TimerNode[]> nodes(new TimerNode[count]);
+            timer.tick();
+            uint64_t start = Metrics::now();
+            for(size_t i = 0; i < count; i++) {
+                timer.addTimer(&nodes[i], timeouts[i], callback);
+            }
+            double ns = Metrics::now() - start;
+            timer.clear();
+            return std::make_pair((uint64_t)count, ns);
+        });
+        bench.runOnce("timer/heap_add" + suffix, [&] {
+            baseline::HeapTimer timer;
+            uint64_t start = Metrics::now();
+            for(size_t i = 0; i < count; i++) {
+                timer.addTimer(i, timeouts[i], callback);
+            }
+            return std::make_pair((uint64_t)count, (double)(Metrics::now() - start));
+        });
+        // 刷新：与连接每次收到请求时一样，把定时重置为同一时长
+        bench.runOnce("timer/wheel_update" + suffix, [&] {
+            TimerManager timer;
+            std::unique_ptr<TimerNode[]> nodes(new TimerNode[count]);
+            timer.tick();
+            for(size_t i = 0; i < count; i++) {
+                timer.addTimer(&nodes[i], timeouts[i], callback);
+            }
+            timer.tick();
+            uint64_t start = Metrics::now();
+            for(size_t i = 0; i < count; i++) {
+                timer.update(&nodes[i], 60000);
+            }
+            double ns = Metrics::now() - start;
+            timer.clear();
+            return std::make_pair((uint64_t)count, ns);
+        });
+        bench.runOnce("timer/heap_update" + suffix, [&] {
+            baseline::HeapTimer timer;
+            for(size_t i = 0; i < count; i++) {
+                timer.addTimer(i, timeouts[i], callback);
+            }
+            uint64_t start = Metrics::now();
+            for(size_t i = 0; i < count; i++) {
+                timer.update(i, 60000);
+            }
+            return std::make_pair((uint64_t)count, (double)(Metrics::now() - start));
+        });
+        // 到期：全部定时器到期后一次处理完，计时只包括处理(含回调)
+        bench.runOnce("timer/wheel_expire" + suffix, [&] {
+            TimerManager timer;
+            std::unique_ptr<TimerNode[]> nodes(new TimerNode[count]);
+            timer.tick();
+            for(size_t i = 0; i < count; i++) {
+                timer.addTimer(&nodes[i], shortTimeouts[i], callback);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(EXPIRE_SPREAD_MS + 10));
+            fired = 0;
+            uint64_t start = Metrics::now();
+            timer.tick();
+            timer.handleExpiredTimer();
+            double ns = Metrics::now() - start;
+            if(fired != count) {
+                fprintf(stderr, "wheel fired %llu of %zu timers\n", (unsigned long long)fired, count);
+                exit(1);
+            }
+            return std::make_pair((uint64_t)count, ns);
+        });
+        bench.runOnce("timer/heap_expire" + suffix, [&] {
+            baseline::HeapTimer timer;
+            for(size_t i = 0; i < count; i++) {
+                timer.addTimer(i, shortTimeouts[i], callback);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(EXPIRE_SPREAD_MS + 10));
+            fired = 0;
+            uint64_t start = Metrics::now();
+            timer.handleExpiredTimer();
+            double ns = Metrics::now() - start;
+            if(fired != count) {
+                fprintf(stderr, "heap fired %llu of %zu timers\n", (unsigned long long)fired, count);
+                exit(1);
+            }
+            return std::make_pair((uint64_t)count, ns);
+        });
+    }
+}
+
+/* ---------------- 线程池：无锁 vs 加锁 ---------------- */
+
+/*  收集派发延迟：每个工作线程写自己的直方图(同AccessLog的每线程队列，按实例编号识别)
+    直方图的总数即已完成的任务数，主线程据此判断任务是否全部执行完，任务中没有共享的计数器
+*/
+class LatencySink {
+public:
+    LatencySink() : id_(nextId_().fetch_add(1)) {};
+
+    Histogram &local() {
+        static thread_local uint64_t owner = 0;
+        static thread_local Histogram *histogram = nullptr;
+        if(owner != id_) {
+            std::lock_guard<std::mutex> lock(mtx_);
+            histograms_.emplace_back(new Histogram());
+            histogram = histograms_.back().get();
+            owner = id_;
+        }
+        return *histogram;
+    }
+
+    Histogram::Snapshot snapshot() {
+        Histogram::Snapshot snapshot;
+        std::lock_guard<std::mutex> lock(mtx_);
+        for(auto &histogram : histograms_) {
+            histogram->mergeTo(snapshot);
+        }
+        return snapshot;
+    }
+
+private:
+    static std::atomic<uint64_t> &nextId_() {
+        static std::atomic<uint64_t> id(1);
+        return id;
+    }
+
+    uint64_t id_;
+    std::mutex mtx_;
+    std::vector<std::unique_ptr<Histogram>> histograms_;
+};
+
+/*  producers个线程共投递tasks个空任务，任务记录从投递到开始执行的时间
+    计时从放行投递线程开始，到所有任务执行完为止
+*/
+template <typename Pool, typename Submit>
+static void runPool(Bench &bench, const std::string &name, int workers, int producers, uint64_t tasks, Submit submit) {
+    if(!bench.selected(name)) {
+        return;
+    }
+    LatencySink sink;
+    uint64_t elapsed;
+    {
+        Pool pool(workers);
+        std::atomic<bool> go(false);
+        std::vector<std::thread> threads;
+        for(int p = 0; p < producers; p++) {
+            uint64_t share = tasks / producers + (p < (int)(tasks % producers) ? 1 : 0);
+            threads.emplace_back([&pool, &go, &sink, &submit, share] {
+                while(!go.load(std::memory_order_acquire)) {
+                    std::this_thread::yield();
+                }
+                for(uint64_t i = 0; i < share; i++) {
+                    uint64_t posted = Metrics::now();
+                    submit(pool, [&sink, posted] { sink.local().record(Metrics::now() - posted); });
+                }
+            });
+        }
+        uint64_t start = Metrics::now();
+        go.store(true, std::memory_order_release);
+        for(std::thread &thread : threads) {
+            thread.join();
+        }
+        while(sink.snapshot().count < tasks) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        elapsed = Metrics::now() - start;
+    }
+    bench.add({name, tasks, (double)elapsed / tasks, 0, (double)sink.snapshot().quantile(0.99)});
+}
+
+static void benchPool(Bench &bench, int workers, uint64_t tasks) {
+    for(int producers : {1, 4}) {
+        std::string suffix = "/p" + std::to_string(producers);
+        runPool<ThreadPool>(bench, "pool/post" + suffix, workers, producers, tasks,
+            [](ThreadPool &pool, auto &&task) {
+                while(!pool.post(task)) {
+                    std::this_thread::yield();
+                }
+            });
+        runPool<ThreadPool>(bench, "pool/enqueue" + suffix, workers, producers, tasks,
+            [](ThreadPool &pool, auto &&task) { pool.enqueue(std::move(task)); });
+        runPool<baseline::LockedThreadPool>(bench, "pool/locked_enqueue" + suffix, workers, producers, tasks,
+            [](baseline::LockedThreadPool &pool, auto &&task) { pool.enqueue(std::move(task)); });
+    }
+}
+
+/* ---------------- 每请求的附加开销 ---------------- */
+
+static void benchOverhead(Bench &bench, int threads) {
+    // 1024个不同IP，令牌充足，只测查表和取令牌的开销
+    std::vector<in_addr_t> ips(1024);
+    for(size_t i = 0; i < ips.size(); i++) {
+        ips[i] = htonl(0x0A000000 | (uint32_t)(i * 2654435761u >> 8));
+    }
+    RateLimitOptions options;
+    options.requestsPerSec = 1000000000;
+    options.maxConnsPerIP = 1 << 20;
+    options.maxConnsPerSubnet = 1 << 20;
+    RateLimiter limiter(options);
+    bench.run("ratelimit/allow_request", [&](uint64_t n) {
+        bool allowed = true;
+        for(uint64_t i = 0; i < n; i++) {
+            allowed &= limiter.allowRequest(ips[i & 1023]);
+        }
+        keep(&allowed);
+    });
+    bench.run("ratelimit/acquire_release_conn", [&](uint64_t n) {
+        for(uint64_t i = 0; i < n; i++) {
+            in_addr_t ip = ips[i & 1023];
+            RateLimiter::ConnToken token;
+            if(limiter.acquireConn(ip, &token)) {
+                limiter.releaseConn(ip, token);
+            }
+        }
+    });
+
+    // 多线程并发检查(reactor接受连接、工作线程处理请求时同时调用)：所有线程查同一IP，或每个线程各查一个IP
+    // 每64次调用抽样计时一次，报告总吞吐和单次调用耗时的p99
+    for(bool sameIP : {true, false}) {
+        std::string name = std::string("ratelimit/allow_request_contended/") + (sameIP ? "same_ip" : "distinct_ip")
+            + "_t" + std::to_string(threads);
+        if(!bench.selected(name)) {
+            continue;
+        }
+        const uint64_t PER_THREAD = 2000000;
+        LatencySink sink;
+        std::atomic<bool> go(false);
+        std::vector<std::thread> workers;
+        for(int t = 0; t < threads; t++) {
+            in_addr_t ip = ips[sameIP ? 0 : t * 101 % ips.size()];
+            workers.emplace_back([&limiter, &sink, &go, ip] {
+                Histogram &latency = sink.local();
+                while(!go.load(std::memory_order_acquire)) {
+                    std::this_thread::yield();
+                }
+                bool allowed = true;
+                for(uint64_t i = 0; i < PER_THREAD; i++) {
+                    if((i & 63) == 0) {
+                        uint64_t start = Metrics::now();
+                        allowed &= limiter.allowRequest(ip);
+                        latency.record(Metrics::now() - start);
+                    } else {
+                        allowed &= limiter.allowRequest(ip);
+                    }
+                }
+                keep(&allowed);
+            });
+        }
+        uint64_t start = Metrics::now();
+        go.store(true, std::memory_order_release);
+        for(std::thread &worker : workers) {
+            worker.join();
+        }
+        uint64_t total = PER_THREAD * threads;
+        bench.add({name, total, (double)(Metrics::now() - start) / total, 0, (double)sink.snapshot().quantile(0.99)});
+    }
+
+    bench.run("metrics/now", [&](uint64_t n) {
+        uint64_t sum = 0;
+        for(uint64_t i = 0; i < n; i++) {
+            sum += Metrics::now();
+        }
+        keep(&sum);
+    });
+    bench.run("metrics/record", [&](uint64_t n) {
+        for(uint64_t i = 0; i < n; i++) {
+            Metrics::record(Metrics::PARSE, i & 0xFFFF);
+        }
+    });
+
+    // 访问日志写到临时文件，不轮转；每轮只写半个环形队列，等后台线程写完再开始下一轮，测到的是入队而不是丢弃
+    char path[] = "/tmp/microbench-accesslog-XXXXXX";
+    int fd = mkstemp(path);
+    if(fd >= 0) {
+        close(fd);
+        AccessLogOptions logOptions;
+        logOptions.path = path;
+        logOptions.rotateBytes = 0;
+        logOptions.rotateSec = 0;
+        logOptions.ringSize = 1 << 16;
+        logOptions.flushMS = 1;
+        {
+            AccessLog log(logOptions);
+            AccessLog::Record record;
+            record.set(ips[0], "GET", "/css/bootstrap.min.css", 200, 121260, Metrics::now());
+            const uint64_t ROUND = logOptions.ringSize / 2;
+            uint64_t appended = 0;
+            bench.runOnce("accesslog/append", [&] {
+                while(log.written() + log.dropped() < appended) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+                uint64_t start = Metrics::now();
+                for(uint64_t i = 0; i < ROUND; i++) {
+                    record.duration = i;
+                    log.append(record);
+                }
+                double ns = Metrics::now() - start;
+                appended += ROUND;
+                return std::make_pair(ROUND, ns);
+            });
+            if(log.dropped() > 0) {
+                fprintf(stderr, "  (accesslog dropped %llu records)\n", (unsigned long long)log.dropped());
+            }
+        }
+        unlink(path);
+    }
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+        "usage: %s [-f filter] [-m minTimeMS] [-r repeats] [-o out.json] [-d resourcesDir] [-n poolTasks] "
+        "[-w poolWorkers] [-N maxTimers]\n"
+        "  -f  run only benchmarks whose name contains filter (all)\n"
+        "  -m  measuring time per benchmark in ms (500)\n"
+        "  -r  repetitions, the median is reported (5)\n"
+        "  -o  write JSON to this file instead of stdout\n"
+        "  -d  resources directory (<cwd>/../resources/)\n"
+        "  -n  tasks per thread pool run (200000)\n"
+        "  -w  thread pool workers, also the thread count of contended benchmarks (4)\n"
+        "  -N  largest timer count, from 10k up by 10x (1000000)\n", name);
+}
+
+int main(int argc, char *argv[]) {
+    std::string filter;
+    int minMS = 500;
+    int repeats = 5;
+    std::string output;
+    std::string srcDir;
+    uint64_t poolTasks = 200000;
+    int workers = 4;
+    size_t maxTimers = 1000000;
+
+    int opt;
+    while((opt = getopt(argc, argv, "f:m:r:o:d:n:w:N:h")) != -1) {
+        switch (opt)
+        {
+        case 'f':
+            filter = optarg;
+            break;
+        case 'm':
+            minMS = std::max(atoi(optarg), 1);
+            break;
+        case 'r':
+            repeats = atoi(optarg);
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        case 'd':
+            srcDir = optarg;
+            break;
+        case 'n':
+            poolTasks = std::max(atoll(optarg), 1LL);
+            break;
+        case 'w':
+            workers = std::max(atoi(optarg), 1);
+            break;
+        case 'N':
+            maxTimers = atoll(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if(srcDir.empty()) {
+        // 与服务器相同：资源目录为<当前目录>/../resources/
+        char *cwd = getcwd(nullptr, 0);
+        srcDir = std::string(cwd ? cwd : ".") + "/../resources/";
+        free(cwd);
+    }
+    if(srcDir.back() != '/') {
+        srcDir += '/';
+    }
+
+    Bench bench(filter, minMS, repeats);
+    benchBuffer(bench);
+    benchParse(bench);
+    if(access((srcDir + "index.html").c_str(), R_OK) == 0) {
+        benchResponse(bench, srcDir);
+    } else {
+        fprintf(stderr, "skipping response benchmarks: %sindex.html not found (use -d)\n", srcDir.c_str());
+    }
+    benchTimer(bench, maxTimers);
+    benchPool(bench, workers, poolTasks);
+    benchOverhead(bench, workers);
+
+    FILE *out = stdout;
+    if(!output.empty()) {
+        out = fopen(output.c_str(), "w");
+        if(!out) {
+            perror(output.c_str());
+            return 1;
+        }
+    }
+    bench.writeJson(out, minMS);
+    if(out != stdout) {
+        fclose(out);
+    }
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,54 @@
+#!/bin/bash
+# 基准测试：依次以4种trigMode和若干线程池大小启动benchserver，用相同的负载压测，汇总为一张表
+# 用法: run_bench.sh <benchserver> <loadgen> [结果目录]
+# 负载和服务器参数由环境变量调整，如 THREADS="2 4" DURATION=5 PIPELINE=8 run_bench.sh ...
+# 在同一台机器上对比不同版本时，保持这些参数不变；应以Release构建(cmake -DCMAKE_BUILD_TYPE=Release)
+set -u
+
+SERVER=${1:?usage: run_bench.sh <benchserver> <loadgen> [outdir]}
+LOADGEN=${2:?usage: run_bench.sh <benchserver> <loadgen> [outdir]}
+OUT=${3:-bench_results}
+
+HERE=$(cd "$(dirname "$0")" && pwd)
+PORT=${PORT:-1316}
+MODES=${MODES:-"0 1 2 3"}  # trigMode
+THREADS=${THREADS:-"1 2 4 8"}  # 线程池大小
+REACTORS=${REACTORS:-4}
+INLINE=${INLINE:-1}
+BACKEND=${BACKEND:-epoll}
+CLIENT_THREADS=${CLIENT_THREADS:-4}
+CONNS=${CONNS:-64}
+DURATION=${DURATION:-10}
+WARMUP=${WARMUP:-2}
+PIPELINE=${PIPELINE:-1}
+KEEPALIVE=${KEEPALIVE:-1}
+RATE=${RATE:-0}    # 0为闭环，否则为开环的总请求速率
+
+mkdir -p "$OUT"
+field() {
+    # 从一行JSON中取出数值字段
+    sed -n "s/.*\"$2\": \([0-9.]*\).*/\1/p" "$1"
+}
+
+printf "%-5s %-7s %12s %9s %8s %9s %9s %9s %9s\n" mode threads "req/s" "MB/s" errors "p50(us)" "p99(us)" "p999(us)" "max(us)"
+for mode in $MODES; do
+    for threads in $THREADS; do
+        # 服务器在bench/中启动，资源目录为../resources/
+        (cd "$HERE" && exec "$SERVER" -p "$PORT" -m "$mode" -t "$threads" -r "$REACTORS" -i "$INLINE" -b "$BACKEND") \
+            > "$OUT/server_m${mode}_t${threads}.log" 2>&1 &
+        pid=$!
+        for _ in $(seq 50); do
+            (exec 3<>"/dev/tcp/127.0.0.1/$PORT") 2>/dev/null && break
+            sleep 0.1
+        done
+        result="$OUT/m${mode}_t${threads}.json"
+        "$LOADGEN" -p "$PORT" -t "$CLIENT_THREADS" -c "$CONNS" -d "$DURATION" -w "$WARMUP" -P "$PIPELINE" \
+            -k "$KEEPALIVE" -r "$RATE" -R "$HERE/../resources" -j > "$result"
+        kill "$pid" 2>/dev/null
+        wait "$pid" 2>/dev/null
+        printf "%-5s %-7s %12s %9s %8s %9s %9s %9s %9s\n" "$mode" "$threads" "$(field "$result" rps)" \
+            "$(field "$result" mbps)" "$(field "$result" errors)" "$(field "$result" p50_us)" \
+            "$(field "$result" p99_us)" "$(field "$result" p999_us)" "$(field "$result" max_us)"
+    done
+done
+echo "results: $OUT"
\ No newline at end of file
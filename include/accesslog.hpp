@@ -0,0 +1,111 @@
+#ifndef ACCESS_LOG_H
+#define ACCESS_LOG_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <fcntl.h>
+#include <unistd.h>
+
+// 访问日志的选项
+struct AccessLogOptions {
+    std::string path;   // 日志文件，为空时不记录
+    size_t rotateBytes = 64 << 20;  // 文件超过该大小后轮转，0表示不按大小轮转
+    int rotateSec = 24 * 3600;  // 每隔该时长(按UTC对齐)轮转，0表示不按时间轮转
+    size_t ringSize = 4096; // 每个线程环形队列的记录数(向上取2的幂)
+    int flushMS = 200;  // 后台线程写出的间隔
+};
+
+/*  异步访问日志：每行记录客户端IP、请求开始时间、方法、路径、状态码、发送字节数和耗时(s)
+    每个写日志的线程有一个单生产者单消费者的无锁环形队列，append()只拷贝定长记录，不加锁、不格式化、不做系统调用
+    后台线程定期(或某个队列过半时)取出所有队列的记录，格式化后成批write()
+    磁盘慢时后台线程阻塞在write()上，队列满后新记录直接丢弃并计数，不会拖慢reactor和工作线程
+    日志文件按大小和时间轮转，旧文件重命名为<path>.<时间>
+    队列在线程首次写日志时创建，随AccessLog释放(线程数固定，不回收退出线程的队列)
+*/
+class AccessLog {
+public:
+    static const size_t METHOD_LEN = 8;
+    static const size_t PATH_LEN = 128; // 更长的路径截断
+
+    // 一条访问记录，定长，可直接在队列中拷贝
+    struct Record {
+        uint64_t start; // 请求开始的时刻(Metrics::now()，ns)
+        uint64_t duration;  // 从开始解析到响应发送完的时长(ns)
+        uint64_t bytes; // 发送的字节数
+        uint32_t ip;    // 客户端IP(网络字节序)
+        uint16_t status;
+        uint8_t methodLen;
+        uint8_t pathLen;
+        char method[METHOD_LEN];
+        char path[PATH_LEN];
+
+        void set(uint32_t clientIP, const std::string &requestMethod, const std::string &requestPath,
+            int statusCode, size_t sentBytes, uint64_t startNS);
+    };
+
+    explicit AccessLog(const AccessLogOptions &options);
+    ~AccessLog();   // 写出队列中剩余的记录后关闭文件
+
+    bool isOpen() const { return enabled_; };   // 日志文件已打开，后台线程在运行
+    void append(const Record &record);  // 任意线程调用，从不阻塞
+    uint64_t written() const { return written_.load(std::memory_order_relaxed); };  // 已写出的记录数
+    uint64_t dropped() const;   // 队列满或写文件失败而丢弃的记录数
+
+private:
+    // 单生产者单消费者环形队列
+    struct Ring {
+        explicit Ring(size_t capacity);
+        std::unique_ptr<Record[]> records;
+        size_t mask;
+        char pad0_[64];
+        std::atomic<size_t> head;   // 下一个写位置，生产者更新
+        char pad1_[64];
+        std::atomic<size_t> tail;   // 下一个读位置，后台线程更新
+        std::atomic<uint64_t> dropped;  // 队列满时丢弃的记录数，生产者更新
+        char pad2_[64];
+    };
+    Ring &ring_();  // 当前线程的队列，首次调用时创建
+
+    void run_();    // 后台线程
+    void drain_(Ring &ring);    // 取出队列中的所有记录，格式化到out_
+    void format_(const Record &record);
+    void flush_();  // 写出out_，必要时先轮转
+    bool openFile_();
+    void rotate_();
+    void updateClock_();    // 校准单调时钟到墙上时间的换算
+
+    static const size_t BATCH_BYTES = 256 << 10;    // out_超过该大小就写出一次
+
+    AccessLogOptions options_;
+    uint64_t id_;   // 实例编号，区分线程缓存的队列属于哪个实例
+    bool enabled_;  // 构造后不再改变，生产者据此判断是否记录
+    int fd_;    // 只在后台线程中使用(轮转时会改变)
+    size_t fileBytes_;  // 当前文件的大小
+    int64_t nextRotate_;    // 下一次按时间轮转的时刻(s)，0表示不按时间轮转
+
+    mutable std::mutex mtx_;
+    std::condition_variable cond_;
+    std::vector<std::unique_ptr<Ring>> rings_;  // 受mtx_保护
+    bool stop_;
+    std::atomic<bool> wake_;    // 有队列过半，需要提前写出
+    std::atomic<uint64_t> written_;
+    std::atomic<uint64_t> writeDropped_;  // 写文件失败丢弃的记录数
+
+    // 以下只在后台线程中使用
+    std::string out_;   // 待写出的日志
+    size_t outRecords_;    // out_中的记录数
+    int64_t wallOffsetNS_;  // 墙上时间 - 单调时间(ns)
+    int64_t cachedSec_; // dateCache_对应的秒
+    char dateCache_[32];    // 格式化后的时间(到秒)
+
+    std::thread thread_;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,44 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <string>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <unistd.h>
+#include <sys/socket.h>
+
+// 准入控制的阈值
+struct AdmissionOptions {
+    int maxConns = 0;   // 连接数达到该值后新连接直接以503拒绝，0表示只受MAX_FD限制
+    size_t maxQueueDepth = 0;   // 线程池中排队的任务数达到该值后拒绝新请求，0表示不限制
+    int maxQueueDelayMS = 0;    // 任务在线程池中的排队时长(平滑值)超过该值且仍有排队时拒绝新请求，0表示不限制
+    int retryAfterSec = 1;  // 503响应中的Retry-After(秒)
+};
+
+/*  准入控制：过载时在排队之前就以预先生成的503拒绝，已接纳的请求延迟保持有界，而不是所有请求一起变慢
+    观察三个信号：连接数(accept时)、线程池排队的任务数和任务的排队时长(把请求交给线程池前)
+    排队时长取指数平滑值；只有队列非空时才据此拒绝，队列排空后立即恢复接纳，不会因为没有新样本而一直拒绝
+    可在任意线程调用
+*/
+class AdmissionControl {
+public:
+    explicit AdmissionControl(const AdmissionOptions &options);
+
+    bool admitConn(int conns) const;    // 是否接纳新连接
+    bool admitRequest(size_t queueDepth) const; // 是否把请求交给线程池
+    void recordQueueDelay(uint64_t us);  // 工作线程取出任务时记录排队时长
+    uint64_t queueDelayUS() const { return delayUS_.load(std::memory_order_relaxed); };    // 排队时长的平滑值(us)
+
+    void sendReject(int fd);    // 丢弃已到达的请求数据并发送503，由调用者关闭fd
+    static void reply(int fd, const std::string &response); // 丢弃已到达的请求数据并发送预先生成的拒绝响应
+    uint64_t rejected() const { return rejected_.load(std::memory_order_relaxed); };   // 已拒绝的次数
+
+private:
+    AdmissionOptions options_;
+    std::string response_;  // 预先生成的503响应
+    std::atomic<uint64_t> delayUS_;
+    std::atomic<uint64_t> rejected_;
+};
+
+#endif
\ No newline at end of file
@@ -3,53 +3,80 @@
 
 #include <iostream>
 #include <vector>
-#include <atomic>
+#include <string>
+#include <algorithm>
 #include <unistd.h>
 #include <cstring>
 #include <assert.h>
 #include <sys/uio.h>
+#include "bufferpool.hpp"
 
+/*  读写缓冲区：由BufferPool中定长的块串成的链，第一次写入时才申请
+    读fd时用readv直接读入尾块的空闲部分和新申请的块；写fd时把各块导出为iovec，用writev发送
+    数据写入后不再移动：扩容只是在链尾挂新块，读完的块立即归还BufferPool
+    缓冲区同一时刻只被一个线程访问，读写位置使用普通变量
+    连接空闲时调用Release()归还存储，空闲连接不占用缓冲区内存
+*/
 class Buffer {
 public:
-    Buffer(int initBufferSize = 1024);
-    ~Buffer() = default;
+    static const size_t CHUNK_SIZE = 4096;  // 默认的块大小
+    static const int MAX_READ_CHUNKS = 16;  // 一次readv最多新申请的块数
+
+    Buffer(int chunkSize = CHUNK_SIZE);
+    ~Buffer();
+    Buffer(Buffer &&other);
+    Buffer(const Buffer&) = delete;
+    Buffer &operator=(const Buffer&) = delete;
 
     // 获取缓冲区信息的接口
     size_t readableBytes() const; // 可读的字节长度
-    size_t writeableBytes() const;// 可写的字节长度
-    size_t prependableBytes() const;// 头部预留字节长度
+    size_t writeableBytes() const;// 尾块中可写的字节长度
+    size_t prependableBytes() const;// 首块中已读的字节长度
+    size_t contiguousBytes() const; // 首块中连续可读的字节长度
+    size_t capacity() const;  // 占用的存储大小
 
     // 缓冲区与客户端fd的读写接口
     ssize_t ReadFd(int fd, int *Errno); // 将数据从fd读入缓冲区
     ssize_t WriteFd(int fd, int *Errno);// 将数据从缓冲区写入fd
+    // 把可读数据中[offset, offset + len)导出为iovec，最多maxIov个；返回使用的个数，exported返回导出的字节数
+    int PeekIov(size_t offset, size_t len, struct iovec *iov, int maxIov, size_t *exported) const;
 
     // 缓冲区与应用程序间的读写接口
     // 程序从缓冲区中读入数据
     void Retrieve(size_t len);  // 从buffer中读取len个字节
-    void RetrieveUntill(const char *end); // 读取到指定地址end
+    void RetrieveUntill(const char *end); // 读取到指定地址end(须在首块中)
     void RetrieveAll(); // 读完缓冲区中的所有字节
+    void Release(); // 丢弃所有数据并把存储还给BufferPool
+    std::string RetrieveToString(size_t len);   // 将前len个可读字节转成string
     std::string RetrieveAllToString();  // 将可读数据转成string
+    void Pullup(size_t len);    // 使前len个可读字节在首块中连续(跨块时拷贝到一个新块)
     // 程序向缓冲区追加数据
     void Append(const std::string &str);
     void Append(const char *str, size_t len);
     void Append(const void *data, size_t len);
     void Append(const Buffer &buffer);
-    void EnsureWriteable(size_t len); // 确保长度为len的数据可写入
+    void EnsureWriteable(size_t len); // 确保尾块中有len字节连续可写
     void UpdateWritePtr(size_t len);  // 修改写后的索引位置
 
-    // 获取当前的读写指针(地址)
+    // 获取当前的读写指针(地址)：读指针在首块中，写指针在尾块中
     const char *curReadPtr() const;
     char *curWritePtr();
     const char *curWritePtrConst() const;
     
 private:
-    char *BeginPtr_();  // 获取缓冲区的内存起始地址
-    const char *BeginPtr_() const;
-    void MakeSpace(size_t len); // 扩充缓冲区空间
+    struct Chunk {
+        char *data;
+        size_t capacity;
+        size_t readPos; // 读的位置(块中的索引)
+        size_t writePos;    // 写的位置(索引)
+    };
+    void AddChunk_(size_t len);  // 在链尾挂一个至少len字节的新块
+    void PopChunk_();   // 归还首块：只前移head_，已归还的块占到一半时才整体前移
 
-    std::vector<char> buffer_;  // 应用层的读写缓冲区
-    std::atomic<size_t> readPos_;  // 读的位置(缓冲区中的索引)  //原子变量，保证数据访问的互斥
-    std::atomic<size_t> writePos_;  // 写的位置(索引)
+    std::vector<Chunk> chunks_; // 块链，未申请时为空；[0, head_)是已归还的块
+    size_t head_;   // 首块的下标
+    size_t chunkSize_;  // 新块的大小
+    size_t readable_;   // 所有块中可读的字节数
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,58 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <mutex>
+#include <vector>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+
+/*  进程级的分级内存块池，为Buffer提供存储
+    块大小为1KB~1MB的2的幂，共11级；更大的块直接malloc/free
+    每个线程有一个小缓存，缓存满/空时成批与全局空闲链表交换，大多数申请和归还不加锁
+    全局空闲链表每级最多缓存MAX_CACHED_BYTES字节，多余的块直接释放
+*/
+class BufferPool {
+public:
+    static BufferPool &instance();
+
+    char *acquire(size_t size, size_t *capacity);   // 申请至少size字节的块，capacity返回实际大小
+    void release(char *block, size_t capacity); // 归还acquire得到的块
+
+    size_t bytesInUse() const { return inUse_.load(std::memory_order_relaxed); };  // 已借出的字节数
+    size_t bytesCached() const { return cached_.load(std::memory_order_relaxed); }; // 全局空闲链表中缓存的字节数
+
+    static const size_t MIN_BLOCK = 1024;   // 最小块1KB
+    static const int CLASSES = 11;  // 1KB ~ 1MB
+    static const size_t MAX_CACHED_BYTES = 16 << 20;   // 全局空闲链表每级最多缓存16MB
+    static const int LOCAL_MAX = 16;   // 线程缓存每级最多缓存的块数
+    static const int BATCH = 8; // 线程缓存与全局链表一次交换的块数
+
+private:
+    BufferPool() : inUse_(0), cached_(0) {};
+    BufferPool(const BufferPool&) = delete;
+    BufferPool &operator=(const BufferPool&) = delete;
+
+    static int classOf_(size_t size);   // size对应的级别，超过最大级别返回-1
+    static size_t classSize_(int cls) { return MIN_BLOCK << cls; };
+
+    // 线程缓存，线程退出时归还到全局空闲链表
+    struct LocalCache {
+        char *blocks[CLASSES][LOCAL_MAX];
+        int count[CLASSES] = {0};
+        ~LocalCache();
+    };
+    static LocalCache &local_();
+    void refill_(int cls, LocalCache &cache);    // 从全局链表取一批块到线程缓存
+    void flush_(int cls, LocalCache &cache, int n);    // 把线程缓存中的n个块还给全局链表
+
+    struct FreeList {
+        std::mutex mtx;
+        std::vector<char*> blocks;
+    };
+    FreeList lists_[CLASSES];
+    std::atomic<size_t> inUse_;
+    std::atomic<size_t> cached_;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,47 @@
+#ifndef CONN_SLAB_H
+#define CONN_SLAB_H
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <atomic>
+#include <assert.h>
+#include "timer.hpp"
+#include "httpconnect.hpp"
+
+/*  按fd索引的连接槽位表，代替unordered_map<int, HttpConn>
+    槽位按块(CHUNK_SIZE个)分配，地址固定不变，只有用到的fd范围才占内存；
+    槽位中只放事件循环每次都要访问的热数据(代数、定时器)，请求/响应等冷数据在单独分配的HttpConn中，首次使用时创建，之后复用
+    每次把槽位分配给新连接时代数加1，epoll事件携带 代数<<32|fd，fd被复用后旧连接残留的事件能直接识别出来
+*/
+class ConnSlab {
+public:
+    struct Slot {
+        uint32_t gen;   // 代数，0表示从未使用
+        TimerNode timer;    // 连接的超时定时器
+        HttpConn *conn; // 冷数据
+        Slot *nextPending;  // 交给reactor的待处理连接链表(工作线程写入，reactor取走)
+        uint32_t pendingEvents; // 待重新注册的事件，0表示关闭连接
+    };
+
+    explicit ConnSlab(int capacity);
+    ~ConnSlab();
+
+    Slot *open(int fd); // 分配给fd上的新连接，代数加1；fd超出容量时返回nullptr
+    Slot *find(uint64_t token); // 查找事件对应的槽位，连接已被替换时返回nullptr
+    Slot &at(int fd);   // 正在使用的fd对应的槽位
+    size_t bytes() const { return bytes_.load(std::memory_order_relaxed); };  // 槽位块和HttpConn占用的字节数(不含缓冲区)
+
+    static uint64_t token(int fd, uint32_t gen) { return (uint64_t)gen << 32 | (uint32_t)fd; };
+    static int tokenFd(uint64_t token) { return (int)(uint32_t)token; };
+
+private:
+    static const int CHUNK_BITS = 10;
+    static const int CHUNK_SIZE = 1 << CHUNK_BITS;
+
+    int capacity_;  // 可容纳的最大fd+1
+    std::vector<std::unique_ptr<Slot[]>> chunks_;   // 按需分配的槽位块
+    std::atomic<size_t> bytes_; // 可在其他线程读取，用于内存报告
+};
+
+#endif
\ No newline at end of file
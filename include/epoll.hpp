@@ -2,29 +2,39 @@
 #define EPOLL_H
 
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <vector>
 #include <assert.h>
+#include "poller.hpp"
 
-class Epoll {
+class Epoll : public Poller {
 public:
     Epoll(int maxEvent = 1024);
     ~Epoll();
 
     // 对fd的操作
-    bool addFd(int fd, uint32_t events);    // 将fd加入Epoll实例
-    bool modFd(int fd, uint32_t events);    // 修改fd对应的事件
-    bool rmFd(int fd);     // 从Epoll实例中移除fd
+    using Poller::addFd;
+    using Poller::modFd;
+    bool addFd(int fd, uint32_t events, uint64_t data) override;    // 将fd加入Epoll实例，事件携带data
+    bool modFd(int fd, uint32_t events, uint64_t data) override;    // 修改fd对应的事件，事件携带data
+    bool rmFd(int fd) override;     // 从Epoll实例中移除fd
     // 返回准备就绪的fd集合
-    int wait(int timeMS = -1);    // 成功则返回就绪fd的数量
+    int wait(int timeMS = -1) override;    // 成功则返回就绪fd的数量
+    void wakeup() override;    // 写eventfd唤醒epoll_wait
 
     // 对外接口：返回就绪fd的信息
-    int getEventFd(size_t i) const; // 获取就绪的fd
-    uint32_t getEvents(size_t i) const; // 获取就绪fd对应的事件
+    uint64_t getEventData(size_t i) const override; // 获取就绪事件携带的data
+    uint32_t getEvents(size_t i) const override; // 获取就绪fd对应的事件
+
+    const char *name() const override { return "epoll"; };
 
 private:
+    static const uint64_t WAKE_TAG = ~(uint64_t)0;  // wakeFd_的事件携带的data
+
     int epollfd_;   // epoll_create()的返回值
+    int wakeFd_;    // 唤醒用的eventfd
     std::vector<struct epoll_event> events_;  // 检测到的就绪事件集合
 };
 
@@ -0,0 +1,126 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string>
+#include <cstdint>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <unordered_map>
+
+/*  缓存的静态文件，最后一个持有者释放时munmap/close
+    小文件只读映射到内存，通过writev发送；
+    大文件不映射(避免逐页缺页)，保留打开的fd，通过sendfile发送
+*/
+class MappedFile {
+public:
+    MappedFile(const std::string &path, const struct stat &st, char *addr, int fd)
+        : path(path), st(st), addr(addr), fd(fd), checkedAt(0) {
+        for(auto &header : headers) {
+            header = nullptr;
+        }
+    }
+    ~MappedFile() {
+        for(auto &header : headers) {
+            delete header.load();
+        }
+        if(addr) {
+            munmap(addr, st.st_size);
+        }
+        if(fd >= 0) {
+            close(fd);
+        }
+    }
+
+    size_t size() const { return st.st_size; };
+
+    const std::string path; // 文件路径(缓存的key)
+    const struct stat st;   // 映射时的文件状态信息
+    char *const addr;   // 映射地址，空文件或大文件为nullptr
+    const int fd;   // 大文件保留的只读fd，其余为-1
+    mutable std::atomic<int64_t> checkedAt;  // 上一次确认文件未变化的时间(FileCache的时钟)，在锁外stat()后直接发布
+
+    // 由HttpResponse首次使用时生成的预序列化响应头(按状态码、长连接、编码区分)，与文件同生命周期
+    static const int HEADER_SLOTS = 20;
+    mutable std::atomic<const std::string*> headers[HEADER_SLOTS];
+};
+
+typedef std::shared_ptr<const MappedFile> FilePtr;  // 引用计数由正在发送的响应持有
+
+/*  进程级的静态文件映射缓存
+    同一文件只open/mmap一次，所有连接共享同一份映射；
+    命中时每隔REVALIDATE_MS才stat()一次检查mtime/size/inode是否变化，其余请求不产生文件系统调用，stat()在锁外进行；
+    按路径哈希分为SHARDS个分片，各有一把锁、一张表和一条LRU链，不同文件的命中互不阻塞；
+    容量上限平均分给各分片，分片内映射字节数超过上限时按LRU淘汰，被淘汰的映射在仍在发送它的响应结束后才真正munmap；
+    大文件不计入映射字节数，但各占一个fd，其数量另有上限，超过时淘汰最久未用的大文件
+*/
+class FileCache {
+public:
+    static FileCache &instance();
+
+    // 获取path对应的文件映射，失败返回errno(ENOENT/EISDIR/EACCES...)，成功返回0
+    int acquire(const std::string &path, FilePtr *file);
+    /*  只获取文件状态信息，不打开文件：命中时同时返回缓存的映射，未命中时只stat()，file置空
+        用于条件请求，304响应无需open/mmap
+    */
+    int lookup(const std::string &path, FilePtr *file, struct stat *st);
+    /*  是否已映射在缓存中且无需重新检查，不产生文件系统调用；用于判断请求能否在reactor线程中直接处理
+        是时若file不为空，同时取得映射，生成响应时不必再查找
+    */
+    bool isHot(const std::string &path, FilePtr *file = nullptr);
+
+    void setCapacity(size_t bytes); // 设置映射总字节数上限
+    void setMaxFds(size_t fds); // 设置缓存中保留fd的大文件数上限
+    void clear();
+
+    static const size_t DEFAULT_CAPACITY = 256 << 20;   // 默认上限256MB
+    static const size_t MMAP_MAX = 256 << 10;   // 超过该大小的文件不映射，改用sendfile发送
+    static const size_t DEFAULT_MAX_FDS = 128;  // 默认最多缓存128个大文件的fd
+    static const int REVALIDATE_MS = 1000;  // 命中时检查文件是否变化的间隔
+
+private:
+    FileCache() : capacity_(DEFAULT_CAPACITY), maxFds_(DEFAULT_MAX_FDS) {};
+    FileCache(const FileCache&) = delete;
+    FileCache &operator=(const FileCache&) = delete;
+
+    typedef std::chrono::steady_clock Clock;
+    typedef std::list<std::string> LruList;   // 表头为最近使用
+
+    struct Entry {
+        FilePtr file;
+        LruList::iterator lru;  // 在lru中的位置
+    };
+    typedef std::unordered_map<std::string, Entry> EntryMap;
+
+    struct Shard {
+        std::mutex mtx;
+        size_t bytes = 0;  // 当前缓存的映射字节数
+        size_t fds = 0;    // 当前缓存中保留fd的大文件数
+        LruList lru;
+        EntryMap entries;
+    };
+    static const int SHARDS = 16;
+
+    static int load_(const std::string &path, FilePtr *file);  // stat + open + mmap
+    static int check_(const struct stat &st);  // 检查文件是否可以发送
+    static int64_t ticks_(Clock::time_point t) { return t.time_since_epoch().count(); };
+    static bool fresh_(const MappedFile &file, Clock::time_point now);   // 距上一次检查不超过REVALIDATE_MS
+    Shard &shard_(const std::string &path) { return shards_[std::hash<std::string>()(path) % SHARDS]; };
+    bool hit_(Shard &shard, const std::string &path, FilePtr *file);  // 查找缓存项，到达检查间隔时在锁外stat()
+    static bool sameFile_(const struct stat &a, const struct stat &b);
+    static size_t mappedBytes_(const MappedFile &file);
+    static void erase_(Shard &shard, EntryMap::iterator it);
+    void evict_(Shard &shard);  // 淘汰到分片的字节数和fd数都不超过上限，需持有分片的锁
+
+    std::atomic<size_t> capacity_;   // 映射总字节数上限
+    std::atomic<size_t> maxFds_; // 保留fd的大文件数上限
+    Shard shards_[SHARDS];
+};
+
+#endif
\ No newline at end of file
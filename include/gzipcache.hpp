@@ -0,0 +1,89 @@
+#ifndef GZIP_CACHE_H
+#define GZIP_CACHE_H
+
+#include <sys/stat.h>
+#include <string>
+#include <cstring>
+#include <list>
+#include <queue>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <unordered_map>
+#include <zlib.h>
+#include "filecache.hpp"
+
+/*  进程级的gzip压缩内容缓存
+    优先使用与源文件同目录的.gz预压缩文件；没有时由后台线程压缩一次，
+    压缩结果放在匿名映射中，以MappedFile的形式与普通文件一样发送；
+    缓存项与源文件的inode/大小/修改时间绑定，源文件变化后重新压缩；
+    与FileCache一样按路径哈希分片，各分片一把锁；每个缓存项(包括等待压缩、不压缩、使用预压缩文件的)另计ENTRY_COST字节，
+    压缩内容和缓存项的总字节数超过上限时按LRU淘汰，缓存项的数量因此也有上限
+*/
+class GzipCache {
+public:
+    static GzipCache &instance();
+
+    /*  获取path(状态为st)的gzip内容，不阻塞：
+        有可用的压缩内容时返回true；否则返回false，并在需要时提交后台压缩任务，本次应发送未压缩的文件
+    */
+    bool find(const std::string &path, const struct stat &st, FilePtr *gz);
+
+    void setCapacity(size_t bytes); // 设置压缩内容总字节数上限
+
+    static const size_t DEFAULT_CAPACITY = 64 << 20;    // 默认上限64MB
+    static const size_t MAX_SOURCE = 4 << 20;   // 超过该大小的文件不做运行时压缩
+    static const size_t ENTRY_COST = 256;   // 每个缓存项计入上限的固定字节数(另加路径长度)
+
+private:
+    GzipCache();
+    ~GzipCache();
+    GzipCache(const GzipCache&) = delete;
+    GzipCache &operator=(const GzipCache&) = delete;
+
+    typedef std::list<std::string> LruList;   // 表头为最近使用
+
+    enum State {
+        Pending,    // 等待后台压缩
+        Sidecar,    // 使用.gz预压缩文件
+        Compressed, // 已压缩到内存
+        Skipped,    // 不值得压缩(压缩失败或压缩后不更小)
+    };
+
+    struct Entry {
+        State state;
+        struct stat src;    // 源文件状态，变化后缓存项失效
+        FilePtr gz;     // Compressed状态下的压缩内容
+        std::string gzPath; // Sidecar状态下预压缩文件的路径，创建缓存项时拼接一次
+        LruList::iterator lru;
+    };
+    typedef std::unordered_map<std::string, Entry> EntryMap;
+
+    struct Shard {
+        std::mutex mtx;
+        size_t bytes = 0;  // 压缩内容和缓存项的字节数
+        LruList lru;
+        EntryMap entries;
+    };
+    static const int SHARDS = 16;
+
+    void work_();   // 后台压缩线程
+    static FilePtr compress_(const std::string &path, const struct stat &st);    // 读取并压缩文件
+    static bool sameSource_(const struct stat &a, const struct stat &b);
+    Shard &shard_(const std::string &path) { return shards_[std::hash<std::string>()(path) % SHARDS]; };
+    static size_t cost_(const std::string &path, const Entry &entry);  // 缓存项计入上限的字节数
+    static void erase_(Shard &shard, EntryMap::iterator it);
+    void evict_(Shard &shard);  // 需持有分片的锁
+
+    std::mutex jobMtx_; // 保护jobs_和isStop_
+    std::condition_variable cond_;
+    std::queue<std::pair<std::string, struct stat>> jobs_;   // 待压缩的文件
+    std::thread worker_;
+    bool isStop_;
+
+    std::atomic<size_t> capacity_;  // 总字节数上限，平均分给各分片
+    Shard shards_[SHARDS];
+};
+
+#endif
\ No newline at end of file
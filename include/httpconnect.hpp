@@ -2,24 +2,36 @@
 #define HTTP_CONNECT_H
 
 #include <atomic>
+#include <vector>
+#include <memory>
 #include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
 #include "httprequest.hpp"
 #include "httpresponse.hpp"
 #include "buffer.hpp"
+#include "ratelimit.hpp"
+#include "metrics.hpp"
+#include "accesslog.hpp"
 
 class HttpConn {
 public:
     HttpConn();
     ~HttpConn();
 
-    void initConn(int sockfd, const sockaddr_in& addr);  // 初始化该连接 
+    void initConn(int sockfd, const sockaddr_in& addr, const RateLimiter::ConnToken &limitToken);  // 初始化该连接 
     void closeConn();   // 关闭该连接
 
     // 读写接口
     ssize_t readBuffer(int *saveError);
     ssize_t writeBuffer(int *saveError);
 
-    bool handleConn();  // 业务逻辑：解析request并生成response
+    /*  业务逻辑：解析缓冲区中所有完整的request(流水线)并依次生成response，返回是否有待发送的响应
+        fastOnly为true时(在reactor线程中运行)，遇到需要文件I/O等较慢处理的请求就停下，
+        该请求保留到下一次fastOnly为false的调用(工作线程)中处理，isDeferred()返回true
+    */
+    bool handleConn(bool fastOnly = false);
+    bool isDeferred() const { return pending_ != HttpRequest::NeedMore; };
 
     // 获取连接的信息
     const char* getIP() const { return inet_ntoa(addr_.sin_addr); };
@@ -27,25 +39,59 @@ public:
     int getFd() const { return fd_; };
     sockaddr_in getAddr() const { return addr_; };
 
-    int writeBytes();   // 获取已写入的数据长度
-    bool isKeepAlive() { return request_.isKeepAlive(); };
+    int writeBytes();   // 获取待写入的数据长度
+    bool isKeepAlive() { return keepAlive_; };   // 本批最后一个响应后是否保持连接
 
     static bool isET;   // 边缘触发or水平触发
     static const char* srcDir;  // 目录路径
     static std::atomic<int> userNum;    // 用户数量
+    static RateLimiter *limiter;    // 按客户端地址限流，连接关闭时归还连接数，每个请求检查请求速率
+    static const char* metricsPath; // 以Prometheus文本格式输出运行指标的路径，为nullptr时不提供
+    static AccessLog *accessLog;    // 访问日志，为nullptr时不记录
 private:
     int fd_;    // HTTP连接对应的fd
     struct sockaddr_in addr_;   // client的地址
+    RateLimiter::ConnToken limitToken_; // 接受连接时在limiter中实际计入的连接数，关闭时归还
     bool isClose_;   // 是否关闭HTTP连接
+    bool keepAlive_;    // 本批最后一个响应后是否保持连接
     
-    int iovCnt_;    // writev()参数
-    struct iovec iov_[2];   // vector I/O
+    /*  发送队列：一批流水线请求的所有响应按顺序排成的分段链out_[segIdx_:]
+        常规生成的响应头在writeBuffer_中(按顺序对应链中data为空、fd为-1的分段)，发送后从缓冲区取走；
+        其余分段发送后就地前移起点、减少长度
+        连续的内存数据(可跨越多个响应)用一次sendmsg发出，文件区间用sendfile发送
+    */
+    size_t queueResponse_(const HttpResponse &response, size_t headLen); // 将一个响应加入发送队列，返回其字节数
+    bool isFast_(); // 当前请求能否在reactor线程中处理：GET且文件已在缓存中映射(同时取得映射存入hotFile_)，或是请求运行指标
+    FilePtr hotFile_;   // isFast_()查到的映射，交给HttpResponse，不再重复拼接路径和查找缓存
+    std::string filePath_;  // 拼接srcDir和请求路径，复用内存
+    bool isMetrics_() const;    // 当前请求是否为GET metricsPath
+    void serveMetrics_();   // 生成运行指标的响应，整个响应在writeBuffer_中
+    void releaseIdle_();    // 连接空闲：把缓冲区还给BufferPool，释放响应对象和请求占用的内存
+    HttpRequest::ParseResult pending_;  // 已解析、留给工作线程处理的请求的解析结果，NeedMore表示没有
+    void consume_(size_t len); // 从发送队列中去掉已发送的len个字节
+
+    /*  访问日志：本批每个响应一条记录，整批发送完(或连接关闭)时交给accessLog
+        请求的耗时从开始解析算起，到响应的最后一个字节交给内核为止
+    */
+    void logRequest_(int status, size_t bytes);    // 为当前请求生成一条记录
+    void flushLogs_(uint64_t end);  // 提交本批的记录，end为发送完的时刻
+    std::vector<AccessLog::Record> logs_;
+    uint64_t reqStart_; // 当前请求开始解析的时刻，0表示尚未开始
+
+    std::vector<BodySegment> out_;
+    size_t segIdx_;   // 当前发送到的分段
+    size_t outBytes_;  // 发送队列中尚未发送的字节数
+
+    static const int MAX_IOV = 64;   // 一次sendmsg最多合并的分段数
+    static const int MAX_PIPELINE = 16;    // 一批最多处理的流水线请求数
 
     Buffer readBuffer_; // 读缓冲区
     Buffer writeBuffer_;// 写缓冲区
 
     HttpRequest request_;
-    HttpResponse response_;    
+    // 本批请求的响应，在其分段发送完之前保持有效；单独分配，扩容时不移动已有对象，分段中的指针不会失效
+    std::vector<std::unique_ptr<HttpResponse>> responses_;
+    size_t responseCnt_;    // 本批使用的响应数
 };
 
 #endif
\ No newline at end of file
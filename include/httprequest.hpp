@@ -2,11 +2,13 @@
 #define HTTP_REQUEST_H
 
 #include <string>
+#include <vector>
 #include <unordered_map>
 #include <unordered_set>
 #include <algorithm>
-#include <regex>
+#include <strings.h>
 #include "buffer.hpp"
+#include "simdscan.hpp"
 
 class HttpRequest {
 public:
@@ -18,14 +20,28 @@ public:
         Finish, // 完成
     };
 
+    // 解析结果
+    enum ParseResult {
+        NeedMore,   // 报文不完整，等待更多数据
+        Complete,   // 解析出一个完整的请求
+        Malformed,  // 报文格式错误
+    };
+
     HttpRequest() {
         init();
     }
     ~HttpRequest() = default;
 
     void init();    // 初始化HttpRequest类的对象的数据
+    void release(); // 初始化并释放字符串、头部表等占用的内存，用于空闲的连接
+    // 没有解析到一半的请求(请求行未完整到达时数据仍在读缓冲区中，需同时判断缓冲区为空)
+    bool isIdle() const { return parse_state_ == RequestLine || parse_state_ == Finish; };
     
-    bool parse(Buffer &buffer); // 解析从缓冲区中读到的数据
+    /*  增量解析缓冲区中的数据，可跨多次ReadFd()恢复解析
+        每解析完一行就将其从缓冲区取走，未完整到达的行留在缓冲区中等待下次调用
+    */
+    ParseResult parse(Buffer &buffer);
+    bool isFinish() const { return parse_state_ == Finish; };    // 请求是否解析完成
 
     // 获取HTTP信息
     std::string path() const;   // 获取路径
@@ -34,13 +50,20 @@ public:
     std::string version() const;// 获取协议版本
     std::string GetPost(const std::string& key) const; // POST方式下获取key对应的value
     std::string GetPost(const char* key) const;
+    const std::string& GetHeader(const char* key) const;   // 获取请求头部字段(不区分大小写)，不存在则返回空串
     bool isKeepAlive() const;   // 连接是否keep alive
 
+    static const size_t MAX_LINE = 8192;    // 请求行/头部行的最大长度
+    static const size_t MAX_HEADERS = 64;   // 头部字段的最大数量
+    static const size_t MAX_BODY = 1 << 20; // 请求体的最大长度
+
 private:
-    // 解析HTTP请求
-    bool ParseRequestLine(const std::string& line);
-    void ParseHeader(const std::string& line);
-    void ParseBody(const std::string& line);
+    ParseResult ParseLines_(Buffer &buffer);   // 逐行解析，遇到不完整的行即返回NeedMore
+    // 解析HTTP请求，[begin, end)为不含\r\n的一行
+    bool ParseRequestLine(const char *begin, const char *end);
+    bool ParseHeader(const char *begin, const char *end);
+    bool ParseBody(std::string &&body);
+    bool ParseHeaderEnd();  // 解析到空行，检查Content-Length等字段
     
     void ParsePath();   // 解析请求资源的路径
     void ParsePost();   // 若请求体的格式为POST则解析POST报文
@@ -48,8 +71,13 @@ private:
     static int ConvertHex(char ch); // 16进制字符转10进制整数
 
     ParseState parse_state_;    // 解析状态
+    size_t scanned_;    // 当前行已扫描过的字节数，下次从此处继续查找\r\n
+    size_t contentLength_;  // 请求体长度
+    bool isKeepAlive_;  // 由版本号和Connection字段决定
     std::string method_, path_,version_, body_; // 请求方法，路径，协议版本，请求体
-    std::unordered_map<std::string, std::string> header_;   // 请求头部 <key>:<value>
+    // 请求头部 <key>:<value>，前headerCnt_项有效；init()时不释放字符串，连接上的后续请求复用其内存
+    std::vector<std::pair<std::string, std::string>> header_;
+    size_t headerCnt_;
     std::unordered_map<std::string, std::string> post_;     // POST请求表单数据
 
     static const std::unordered_set<std::string> DEFAULT_HTML;  // 默认网页
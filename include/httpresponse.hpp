@@ -4,23 +4,47 @@
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <ctime>
+#include <cstdint>
 #include <fcntl.h>
 #include <assert.h>
 #include <unistd.h>
 #include "buffer.hpp"
+#include "filecache.hpp"
+#include "gzipcache.hpp"
+#include "httprequest.hpp"
+
+/*  响应中的一段：
+    内存数据(映射的文件、multipart分段头部)、待sendfile的文件区间，或连接写缓冲区中的数据(常规生成的响应头)
+*/
+struct BodySegment {
+    const char *data;   // 内存数据；为nullptr时见fd
+    int fd; // data为nullptr时：>=0表示从该文件的offset处sendfile，-1表示数据在连接的写缓冲区中
+    size_t offset;  // sendfile时文件中的偏移
+    size_t len; // 长度
+};
 
 class HttpResponse {
 public:
     HttpResponse();
     ~HttpResponse();
 
-    void init(const std::string& srcDir, std::string& path, bool isKeepAlive = false, int stateCode = -1);  // 响应报文初始化
+    /*  响应报文初始化，request用于读取Range等条件请求头部
+        file为调用方已在FileCache中查到的srcDir+path的映射，此时生成响应时不再拼接路径和查找缓存
+    */
+    void init(const std::string& srcDir, std::string& path, bool isKeepAlive = false, int stateCode = -1,
+            const HttpRequest *request = nullptr, FilePtr file = FilePtr());
     void makeResponse(Buffer& buffer);    // 制作响应报文并传送到缓冲区
-    void unmapFile();   // 取消文件映射
+    void unmapFile();   // 释放对文件映射的引用
     
     int code() const { return stateCode_; };    // 获取状态码
-    char* file() {return mmapFile_; };   // 获取映射后的文件地址
-    size_t fileLength() const {return mmapFileStat_.st_size; };    // 获取映射文件的长度
+    char* file() { return file_ ? file_->addr : nullptr; };   // 获取映射后的文件地址
+    size_t fileLength() const { return file_ ? file_->size() : 0; };    // 获取映射文件的长度
+    int fileFd() const { return file_ ? file_->fd : -1; };  // 未映射的大文件的fd，用于sendfile
+    // 响应体的各分段，依次发送在缓冲区中的头部之后(使用预序列化响应头时，头部也在分段中)
+    const std::vector<BodySegment>& body() const { return body_; };
     void errorContent(Buffer& buffer, std::string message);    // 错误页面
 
 private:
@@ -30,20 +54,57 @@ private:
     void addResponseContent(Buffer& buffer);
 
     void errorHTML();   // 考虑状态码为40X对应的错误网页
+
+    /*  预序列化的响应头：整文件的200、304以及错误页面的响应头只取决于文件、状态码、长连接和编码，
+        首次生成后保存在文件的MappedFile上，之后只需填入当前的Date，由分段直接交给sendmsg发送
+    */
+    bool makeCachedResponse_();
+    int headerSlot_() const;    // 在MappedFile::headers中的下标，不可缓存时返回-1
+    static const char *currentDate_();  // 当前时间的HTTP-date，同一秒内复用格式化结果
     std::string getFileType();  // 获取文件类型
 
+    // 条件请求：If-None-Match/If-Modified-Since命中时返回304，不打开文件
+    bool notModified_() const;
+    bool matchETagList_(const std::string& list) const;    // If-None-Match中是否有与文件一致的ETag(弱比较)
+    void addValidators_(Buffer& buffer);  // ETag、Last-Modified、Cache-Control
+    static std::string makeETag_(const struct stat& st, const struct stat *gz);  // 由inode、大小、修改时间生成ETag，gzip内容另加压缩内容的大小和修改时间
+    static bool parseHttpDate_(const std::string& date, time_t *t);
+
+    bool acceptGzip_() const;   // 客户端的Accept-Encoding是否接受gzip
+
+    // Range请求：解析出的区间存入ranges_，并把状态码改为206/416
+    void parseRange_();
+    bool matchIfRange_(const std::string& ifRange) const;    // If-Range中的验证器是否与文件一致(强比较)
+    void addFileSegment_(size_t begin, size_t end);    // 将文件区间[begin, end)加入响应体
+    static std::string httpDate_(time_t t); // 格式化为HTTP-date，如Sun, 06 Nov 1994 08:49:37 GMT
+
     int stateCode_; // 响应状态码
     bool isKeepAlive_;
 
     std::string path_;    // httprequest解析得到的路径
     std::string srcDir_; // 根目录
 
-    char *mmapFile_;    // 文件内存映射的地址
-    struct stat mmapFileStat_;  // 文件状态信息
+    FilePtr file_;  // 共享的文件映射(来自FileCache)
+    struct stat fileStat_;  // 请求资源的状态信息，304响应时file_为空
+    time_t lastModified_;   // Last-Modified：文件的修改时间，发送gzip内容时取与压缩内容中较晚的
+    std::string etag_;  // 请求资源的ETag
+    bool compressible_; // 资源类型可压缩，响应随Accept-Encoding变化
+    bool gzip_; // 发送gzip内容，此时file_为压缩后的内容
+    const HttpRequest *request_;    // 对应的请求，仅在makeResponse()期间使用
+
+    std::vector<std::pair<size_t, size_t>> ranges_;  // 请求的字节区间[first, last]
+    std::vector<BodySegment> body_;  // 响应体
+    std::string multipart_; // multipart/byteranges的分段头部，body_中的分段指向这里
+    char date_[32]; // 预序列化响应头中Date字段的值
+
+    static const size_t MAX_RANGES = 16;    // 单个请求最多的区间数，超过则忽略Range返回整个文件
+    static const char *BOUNDARY;    // multipart分隔符
 
     static const std::unordered_map<std::string, std::string> SUFFIX_TYPE;  // 后缀名→文件类型
     static const std::unordered_map<int, std::string> CODE_STATE;  // 状态码→状态码描述
     static const std::unordered_map<int, std::string> CODE_PATH;  // 状态码→路径
+    static const std::unordered_map<std::string, std::string> CACHE_CONTROL;  // 文件类型→缓存策略
+    static const std::unordered_set<std::string> COMPRESSIBLE_TYPE;    // 值得gzip压缩的文件类型
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,98 @@
+#ifndef IO_URING_H
+#define IO_URING_H
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <errno.h>
+#include <unistd.h>
+#include <assert.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <linux/io_uring.h>
+#include "poller.hpp"
+
+/*  io_uring事件后端(直接使用系统调用，不依赖liburing)
+    每个fd的注册对应一个IORING_OP_POLL_ADD请求：
+        EPOLLONESHOT：单次poll，完成后须modFd重新注册(与epoll的oneshot一致)
+        EPOLLET：多次poll(IORING_POLL_ADD_MULTI)，每次就绪产生一个完成事件
+        其余：单次poll，事件交出后自动重新提交，再次提交时仍就绪则立即完成，相当于水平触发
+    添加、修改、删除只是往提交队列中写一个请求，在下一次wait()时与等待合并为一次io_uring_enter，省去每次请求的epoll_ctl
+    提交队列和注册信息只由事件循环线程访问，不加锁：threadSafe()返回false，其他线程须把修改交给事件循环线程，
+    再用wakeup()唤醒它；唤醒用的eventfd由环中常驻的READ请求读取，事件循环线程不必再调用read
+    fd关闭前须rmFd：挂起的poll持有文件引用，取消之后连接才会真正关闭
+*/
+class IoUring : public Poller {
+public:
+    IoUring(int maxEvent = 1024, unsigned entries = 4096);
+    ~IoUring();
+
+    bool valid() const { return ringFd_ >= 0; };    // 内核是否支持(io_uring_setup成功)
+
+    using Poller::addFd;
+    using Poller::modFd;
+    bool addFd(int fd, uint32_t events, uint64_t data) override;
+    bool modFd(int fd, uint32_t events, uint64_t data) override;
+    bool rmFd(int fd) override;
+    int wait(int timeMS = -1) override;
+    void wakeup() override;
+
+    uint64_t getEventData(size_t i) const override;
+    uint32_t getEvents(size_t i) const override;
+
+    bool threadSafe() const override { return false; };
+    const char *name() const override { return "io_uring"; };
+
+private:
+    // 每个fd的注册信息，user_data为 序号<<32|fd，序号在每次提交poll时加1，用于丢弃已被取代的poll的完成事件
+    struct Reg {
+        uint64_t data = 0;  // 事件携带的data
+        uint32_t events = 0;    // 注册的事件和标志
+        uint32_t seq = 0;   // 当前poll的序号
+        bool armed = false; // 是否有挂起的poll
+    };
+    struct Event {
+        uint64_t data;
+        uint32_t events;
+    };
+    static const uint64_t REMOVE_TAG = ~(uint64_t)0;   // POLL_REMOVE请求自身完成事件的user_data
+    static const uint64_t WAKE_TAG = ~(uint64_t)1; // 读wakeFd_的READ请求的user_data
+
+    bool setup_(unsigned entries);
+    Reg &reg_(int fd);
+    struct io_uring_sqe *getSqe_(); // 取一个空闲的提交队列项，队列满时先提交
+    void pollAdd_(int fd, Reg &reg);    // 提交poll请求
+    void pollRemove_(int fd, Reg &reg); // 取消挂起的poll
+    void readWake_();   // 提交读wakeFd_的请求
+    int submit_();  // 把队列中的请求交给内核，不等待
+
+    int ringFd_;
+    // 提交队列(SQ)
+    void *sqRing_;
+    size_t sqRingSize_;
+    unsigned *sqHead_;
+    unsigned *sqTail_;
+    unsigned *sqMask_;
+    unsigned *sqArray_;
+    struct io_uring_sqe *sqes_;
+    size_t sqesSize_;
+    unsigned sqEntries_;
+    unsigned localTail_;    // 已写入但尚未对内核发布的尾位置
+    // 完成队列(CQ)
+    void *cqRing_;
+    size_t cqRingSize_;
+    unsigned *cqHead_;
+    unsigned *cqTail_;
+    unsigned *cqMask_;
+    struct io_uring_cqe *cqes_;
+
+    int wakeFd_;    // 唤醒用的eventfd(阻塞模式，由内核在可读时完成READ请求)
+    uint64_t wakeCount_;    // READ请求的缓冲区
+    std::vector<Reg> regs_; // 按fd索引的注册信息
+    std::vector<Event> events_;  // 检测到的就绪事件集合
+    size_t eventCnt_;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,163 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <ctime>
+#include <cstdint>
+#include <cstddef>
+
+/*  对数分桶的直方图(HDR风格)：每个2的幂区间再线性分为4个子桶，相对误差不超过25%
+    0~3各占一桶，最大可区分到2^41，更大的值计入最后一桶
+    只由所属线程写入：计数用relaxed的load+store而不是原子加，开销与普通变量相同，其他线程可随时读取
+*/
+class Histogram {
+public:
+    static const int SUB_BITS = 2;
+    static const int SUB_COUNT = 1 << SUB_BITS; // 每个2的幂区间的子桶数
+    static const int MAX_BITS = 41;
+    static const int BUCKETS = (MAX_BITS - SUB_BITS + 1) * SUB_COUNT;
+
+    Histogram() : sum_(0) {
+        for(auto &bucket : buckets_) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void record(uint64_t value) {
+        std::atomic<uint64_t> &bucket = buckets_[bucketOf(value)];
+        bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        sum_.store(sum_.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    static int bucketOf(uint64_t value) {
+        if(value < SUB_COUNT) {
+            return value;
+        }
+        int msb = 63 - __builtin_clzll(value);
+        if(msb >= MAX_BITS) {
+            return BUCKETS - 1;
+        }
+        int shift = msb - SUB_BITS;
+        return (shift + 1) * SUB_COUNT + ((value >> shift) & (SUB_COUNT - 1));
+    }
+    // 桶的上界(不含)
+    static uint64_t upperBound(int bucket) {
+        if(bucket < SUB_COUNT) {
+            return bucket + 1;
+        }
+        int shift = bucket / SUB_COUNT - 1;
+        return (uint64_t)(SUB_COUNT + bucket % SUB_COUNT + 1) << shift;
+    }
+
+    // 合并后的快照
+    struct Snapshot {
+        uint64_t buckets[BUCKETS] = {0};
+        uint64_t count = 0;
+        uint64_t sum = 0;
+
+        uint64_t countBelow(uint64_t bound) const;   // 小于等于bound的样本数(按桶的上界)
+        uint64_t quantile(double q) const;   // 分位数所在桶的上界
+    };
+    void mergeTo(Snapshot &snapshot) const;
+
+private:
+    std::atomic<uint64_t> buckets_[BUCKETS];
+    std::atomic<uint64_t> sum_;
+};
+
+/*  运行指标：各线程各自计数，抓取时合并，以Prometheus文本格式输出
+    热路径只写本线程的计数，不加锁、不做原子读改写；线程首次记录时登记，退出后其计数留给之后新建的线程继续累加
+    分阶段的耗时(ns)：事件等待、线程池排队、请求解析、生成响应(含stat/mmap)、发送(sendmsg/sendfile)
+    另有每次发送的字节数、投递时线程池的排队任务数、各状态码的响应数和接受的连接数
+    连接数、内存占用、拒绝次数等由WebServer登记为探针，抓取时读取
+*/
+class Metrics {
+public:
+    enum Phase { POLL_WAIT, QUEUE_WAIT, PARSE, RESPONSE, WRITE, PHASES };
+
+    static Metrics &instance();
+
+    // 单调时钟(ns)，用于计算各阶段的耗时
+    static uint64_t now() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    }
+
+    // 以下在任意线程调用，只写本线程的计数
+    static void record(Phase phase, uint64_t ns) { local_().phases[phase].record(ns); };
+    static void recordSince(Phase phase, uint64_t start) { record(phase, now() - start); };
+    static void addBytesSent(size_t bytes) { local_().bytesSent.record(bytes); };
+    static void addQueueDepth(size_t depth) { local_().queueDepth.record(depth); };
+    static void addStatus(int code);
+    static void addAccepted() { inc_(local_().accepted); };
+
+    enum ProbeType { COUNTER, GAUGE };
+    // 登记探针：抓取时调用read取值，name不含前缀
+    void addProbe(const std::string &name, ProbeType type, const std::string &help, std::function<double()> read);
+    void clearProbes();
+
+    std::string render();   // 合并各线程的计数，生成Prometheus文本格式
+
+    static const char *PREFIX;  // 指标名前缀
+    static const int MIN_STATUS = 100;
+    static const int MAX_STATUS = 599;
+
+private:
+    Metrics() = default;
+    Metrics(const Metrics&) = delete;
+    Metrics &operator=(const Metrics&) = delete;
+
+    struct ThreadMetrics {
+        Histogram phases[PHASES];
+        Histogram bytesSent;
+        Histogram queueDepth;
+        std::atomic<uint64_t> status[MAX_STATUS - MIN_STATUS + 1];
+        std::atomic<uint64_t> accepted;
+        bool inUse; // 是否有线程在使用，受mtx_保护
+
+        ThreadMetrics();
+    };
+    static ThreadMetrics &local_() {
+        if(!current_) {
+            attach_();
+        }
+        return *current_;
+    }
+    static void attach_();  // 为当前线程取得一份计数(优先复用已退出线程的)
+    static void detach_(ThreadMetrics *metrics);  // 线程退出
+    static void inc_(std::atomic<uint64_t> &counter) {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    // 直方图的输出方式
+    struct HistogramDesc {
+        const char *name;
+        const char *help;
+        double scale;   // 记录值到输出单位的换算
+        int minBits;    // 输出的le取2^minBits~2^maxBits
+        int maxBits;
+    };
+    static void renderHistogram_(std::string &out, const HistogramDesc &desc, const char *label,
+        const Histogram::Snapshot &snapshot, bool header);
+    static void append_(std::string &out, const char *format, ...);
+
+    struct Probe {
+        std::string name;
+        ProbeType type;
+        std::string help;
+        std::function<double()> read;
+    };
+
+    std::mutex mtx_;
+    std::vector<std::unique_ptr<ThreadMetrics>> threads_;  // 所有线程的计数，只增不减
+    std::vector<Probe> probes_;
+    static thread_local ThreadMetrics *current_;
+};
+
+#endif
\ No newline at end of file
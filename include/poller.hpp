@@ -0,0 +1,44 @@
+#ifndef POLLER_H
+#define POLLER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <sys/epoll.h>
+
+/*  事件后端接口：reactor通过它注册fd、等待就绪事件
+    事件和标志统一使用epoll的定义(EPOLLIN、EPOLLONESHOT、EPOLLET等)，每个事件携带注册时的64位data
+    实现：Epoll(默认，总是可用，可在任意线程修改注册)、IoUring(把注册和修改攒成一批，与等待合并为一次系统调用，只能在事件循环线程中修改)
+    启动时用create()选择，所选后端不可用时退回epoll
+*/
+class Poller {
+public:
+    enum Backend {
+        EPOLL,
+        IO_URING,
+    };
+
+    virtual ~Poller() {};
+
+    // 对fd的操作
+    bool addFd(int fd, uint32_t events) { return addFd(fd, events, (uint32_t)fd); };    // 将fd加入事件后端
+    virtual bool addFd(int fd, uint32_t events, uint64_t data) = 0;    // 将fd加入事件后端，事件携带data
+    bool modFd(int fd, uint32_t events) { return modFd(fd, events, (uint32_t)fd); };    // 修改fd对应的事件
+    virtual bool modFd(int fd, uint32_t events, uint64_t data) = 0;    // 修改fd对应的事件，事件携带data
+    virtual bool rmFd(int fd) = 0;     // 移除fd
+    // 返回准备就绪的fd集合
+    virtual int wait(int timeMS = -1) = 0;    // 成功则返回就绪fd的数量
+    virtual void wakeup() = 0;  // 使阻塞在wait()中的线程返回(可能没有就绪事件)，可在任意线程调用
+
+    // 对外接口：返回就绪fd的信息
+    int getEventFd(size_t i) const { return (int)(uint32_t)getEventData(i); }; // 获取就绪的fd(data的低32位)
+    virtual uint64_t getEventData(size_t i) const = 0; // 获取就绪事件携带的data
+    virtual uint32_t getEvents(size_t i) const = 0; // 获取就绪fd对应的事件
+
+    virtual bool threadSafe() const { return true; };  // 其他线程能否直接调用addFd/modFd/rmFd
+    virtual const char *name() const = 0;   // 后端名称
+
+    static std::unique_ptr<Poller> create(Backend backend, int maxEvent = 1024);   // 创建指定的后端，不可用时返回Epoll
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,99 @@
+#ifndef RATE_LIMIT_H
+#define RATE_LIMIT_H
+
+#include <string>
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <arpa/inet.h>
+
+// 按客户端地址限流的阈值，均为0表示不限制
+struct RateLimitOptions {
+    int maxConnsPerIP = 0;  // 每个IP的连接数上限
+    int maxConnsPerSubnet = 0;  // 每个/24网段的连接数上限
+    int requestsPerSec = 0; // 每个IP每秒补充的令牌数(请求速率)
+    int burst = 0;  // 令牌桶容量(允许的突发请求数)，0表示与requestsPerSec相同，不超过RateLimiter::MAX_BURST
+    int idleSec = 60;   // 没有连接的条目空闲多久后可被新地址复用
+};
+
+/*  按客户端地址限流：每个IP和每个/24网段的连接数上限，以及每个IP的请求速率令牌桶
+    计数存放在分片的开放寻址表中，分片与表项都按缓存行对齐
+    表项的连接数和令牌桶各打包在一个64位字中，用CAS更新：已在表中的地址(绝大多数检查)不加锁
+    只有插入新地址时加所在分片的自旋锁，插入者在锁内重新查找，同一地址不会占用两个表项
+    表项不主动删除：没有连接且空闲超过idleSec的表项在插入时被新地址直接复用；
+    探测超过MAX_PROBE仍找不到位置时放行(宁可不限流，也不误拒)
+    时间取CLOCK_MONOTONIC_COARSE(vDSO，不陷入内核)，一次检查只有一次哈希、一次CAS和几次内存访问
+*/
+class RateLimiter {
+public:
+    explicit RateLimiter(const RateLimitOptions &options);
+    ~RateLimiter();
+    RateLimiter(const RateLimiter&) = delete;
+    RateLimiter &operator=(const RateLimiter&) = delete;
+
+    // acquireConn实际计入了哪些连接数(表满放行时不计入)，随连接保存，关闭时交给releaseConn
+    struct ConnToken {
+        bool ip = false;    // 计入了IP的连接数
+        bool subnet = false;    // 计入了网段的连接数
+    };
+
+    bool limitsConns() const { return options_.maxConnsPerIP > 0 || options_.maxConnsPerSubnet > 0; };
+    bool limitsRequests() const { return options_.requestsPerSec > 0; };
+
+    bool acquireConn(in_addr_t ip, ConnToken *token); // 新连接：计数加1，超过上限时返回false且不计数；token记录实际计入的计数
+    void releaseConn(in_addr_t ip, const ConnToken &token); // 连接关闭：只减少token中计入过的计数
+    bool allowRequest(in_addr_t ip);    // 新请求：从令牌桶中取一个令牌，桶空时返回false
+
+    const std::string &response() const { return response_; };    // 预先生成的429响应
+    uint64_t rejected() const { return rejected_.load(std::memory_order_relaxed); };   // 已拒绝的次数
+
+    static const int SHARDS = 64;   // 分片数
+    static const int SHARD_SIZE = 1024; // 每个分片的表项数(2的幂)
+    static const int MAX_PROBE = 16;    // 线性探测的最大长度
+    static const int MAX_BURST = 268435;    // 令牌桶容量上限(令牌数×1000占28位)
+
+private:
+    /*  表项：两个64位字，各自整体CAS
+        slot：高34位为key(0表示空；第32、33位区分IP(1)与网段(2)，低32位为地址)，低30位为连接数
+        bucket：高36位为上次补充令牌的时刻(ms，相对构造时)，低28位为令牌数×1000
+        key与连接数在同一个字中：复用表项时检查连接数为0和换key是同一次CAS，不会丢失并发计入的连接
+    */
+    struct Entry {
+        std::atomic<uint64_t> slot;
+        std::atomic<uint64_t> bucket;
+    };
+    static const int CONN_BITS = 30;
+    static const uint64_t CONN_MASK = ((uint64_t)1 << CONN_BITS) - 1;
+    static const int TOKEN_BITS = 28;
+    static const uint64_t TOKEN_MASK = ((uint64_t)1 << TOKEN_BITS) - 1;
+
+    struct alignas(64) Shard {
+        std::atomic_flag lock = ATOMIC_FLAG_INIT;   // 只在插入新地址时使用
+        Entry *entries;
+    };
+
+    static uint64_t ipKey_(in_addr_t ip) { return (uint64_t)1 << 32 | ntohl(ip); };
+    static uint64_t subnetKey_(in_addr_t ip) { return (uint64_t)2 << 32 | (ntohl(ip) & 0xFFFFFF00); };
+    static uint64_t hash_(uint64_t key);
+    static uint64_t clockMS_();
+    uint64_t nowMS_() const { return (clockMS_() - startMS_) & (((uint64_t)1 << (64 - TOKEN_BITS)) - 1); };
+    static int64_t elapsed_(uint64_t now, uint64_t stamp);  // now - stamp(36位时间戳的差，可为负)
+    static uint64_t makeBucket_(uint64_t stamp, uint64_t milliTokens) { return stamp << TOKEN_BITS | milliTokens; };
+    bool idle_(uint64_t slot, uint64_t bucket, uint64_t now) const;  // 没有连接且空闲超过idleSec
+    static void lock_(Shard &shard);
+    static void unlock_(Shard &shard) { shard.lock.clear(std::memory_order_release); };
+    static Entry *lookup_(Shard &shard, uint64_t key, uint64_t h);    // 查找key的表项，不加锁，不存在时返回nullptr
+    Entry *find_(Shard &shard, uint64_t key, uint64_t h, uint64_t now);   // 查找或插入key的表项，表满时返回nullptr
+    Entry *insert_(Shard &shard, uint64_t key, uint64_t h, uint64_t now); // 插入key，需持有分片锁
+    bool addConn_(uint64_t key, int limit, bool *charged);  // 连接数加1，超过上限时返回false；表满放行时返回true，charged为false
+    void removeConn_(uint64_t key); // 连接数减1，只用于计入过的连接
+
+    RateLimitOptions options_;
+    uint64_t startMS_;  // 构造时的时钟(ms)
+    int64_t burstMilli_;    // 令牌桶容量×1000
+    Shard *shards_; // SHARDS个分片，按缓存行对齐分配；未开启限制时为nullptr
+    std::string response_;
+    std::atomic<uint64_t> rejected_;
+};
+
+#endif
\ No newline at end of file
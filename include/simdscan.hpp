@@ -0,0 +1,48 @@
+#ifndef SIMD_SCAN_H
+#define SIMD_SCAN_H
+
+#include <cstddef>
+
+/*  HTTP报文分隔符扫描
+    在[begin, end)中查找\r\n、指定字符或控制字符，一次比较16(SSE2)/32(AVX2)字节
+    程序启动时根据CPU特性选择实现，不支持SIMD的平台退化为逐字节扫描
+    所有函数在找不到目标时返回end
+*/
+class SimdScan {
+public:
+    typedef const char *(*FindFunc)(const char *begin, const char *end);
+    typedef const char *(*FindCharFunc)(const char *begin, const char *end, char ch);
+
+    // 一组扫描函数的实现
+    struct Impl {
+        const char *name;   // avx2/sse2/scalar
+        FindFunc findCRLF;
+        FindCharFunc findChar;
+        FindFunc findCtl;
+    };
+
+    // 查找\r\n，返回指向\r的指针
+    static const char *findCRLF(const char *begin, const char *end) {
+        return impl_->findCRLF(begin, end);
+    }
+    // 查找字符ch(如':')
+    static const char *findChar(const char *begin, const char *end, char ch) {
+        return impl_->findChar(begin, end, ch);
+    }
+    // 查找第一个 <= 0x20 的字节(空格或控制字符)，用于切分请求行并校验字段名
+    static const char *findCtl(const char *begin, const char *end) {
+        return impl_->findCtl(begin, end);
+    }
+
+    static const Impl &active() { return *impl_; }; // 当前使用的实现
+    // 各指令集的实现，CPU不支持时返回nullptr
+    static const Impl &scalar();
+    static const Impl *sse2();
+    static const Impl *avx2();
+
+private:
+    static const Impl *select_();   // 根据CPU特性选择实现
+    static const Impl *impl_;
+};
+
+#endif
\ No newline at end of file
@@ -5,88 +5,315 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
-#include <queue>
+#include <atomic>
+#include <memory>
 #include <functional>
 #include <future>
+#include <type_traits>
+#include <cstddef>
+#include <cstdint>
 #include <stdexcept>
 
+/*  任务：定长的小缓冲区可调用对象
+    可调用对象(如lambda)直接构造在内部缓冲区中，不分配堆内存；超过INLINE_SIZE的类型在编译期报错
+    只能移动，不能复制
+*/
+class Task {
+public:
+    static const size_t INLINE_SIZE = 48;   // 内部缓冲区大小，足够容纳捕获若干指针的lambda
+
+    Task() : ops_(nullptr) {};
+    template <typename F, typename = typename std::enable_if<
+        !std::is_same<typename std::decay<F>::type, Task>::value>::type>
+    Task(F &&f) {
+        typedef typename std::decay<F>::type Func;
+        static_assert(sizeof(Func) <= INLINE_SIZE, "callable too large for Task, capture less state");
+        static_assert(alignof(Func) <= alignof(std::max_align_t), "callable over-aligned for Task");
+        new (&buf_) Func(std::forward<F>(f));
+        ops_ = &OpsFor<Func>::table;
+    }
+    Task(Task &&other) noexcept : ops_(other.ops_) {
+        if(ops_) {
+            ops_->move(&buf_, &other.buf_);
+            other.ops_ = nullptr;
+        }
+    }
+    Task& operator=(Task &&other) noexcept {
+        if(this != &other) {
+            reset();
+            ops_ = other.ops_;
+            if(ops_) {
+                ops_->move(&buf_, &other.buf_);
+                other.ops_ = nullptr;
+            }
+        }
+        return *this;
+    }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() { reset(); };
+
+    void operator()() { ops_->invoke(&buf_); };
+    explicit operator bool() const { return ops_ != nullptr; };
+    void reset() {
+        if(ops_) {
+            ops_->destroy(&buf_);
+            ops_ = nullptr;
+        }
+    }
+
+private:
+    // 按类型生成的操作表，代替虚函数
+    struct Ops {
+        void (*invoke)(void *self);
+        void (*move)(void *dst, void *src);  // 移动构造到dst并析构src
+        void (*destroy)(void *self);
+    };
+    template <typename Func>
+    struct OpsFor {
+        static void invoke(void *self) { (*static_cast<Func *>(self))(); };
+        static void move(void *dst, void *src) {
+            new (dst) Func(std::move(*static_cast<Func *>(src)));
+            static_cast<Func *>(src)->~Func();
+        }
+        static void destroy(void *self) { static_cast<Func *>(self)->~Func(); };
+        static const Ops table;
+    };
+
+    typename std::aligned_storage<INLINE_SIZE, alignof(std::max_align_t)>::type buf_;
+    const Ops *ops_;
+};
+
+template <typename Func>
+const Task::Ops Task::OpsFor<Func>::table = {
+    &Task::OpsFor<Func>::invoke, &Task::OpsFor<Func>::move, &Task::OpsFor<Func>::destroy
+};
+
+/*  有界无锁任务队列(多生产者多消费者环形队列)
+    每个槽带一个序号：序号等于写位置时可写，等于读位置+1时可读，生产者和消费者各自用CAS抢占位置
+    每个工作线程持有一个队列：reactor线程向其中投递，本线程和窃取任务的其他线程从中取出
+*/
+class TaskQueue {
+public:
+    explicit TaskQueue(size_t capacity) : cells_(new Cell[roundUp_(capacity)]), mask_(roundUp_(capacity) - 1) {
+        for(size_t i = 0; i <= mask_; i++) {
+            cells_[i].seq.store(i, std::memory_order_relaxed);
+        }
+        head_.store(0, std::memory_order_relaxed);
+        tail_.store(0, std::memory_order_relaxed);
+    }
+
+    // 入队，队列满时返回false，task保持不变
+    bool push(Task &task) {
+        size_t pos = head_.load(std::memory_order_relaxed);
+        while(true) {
+            Cell &cell = cells_[pos & mask_];
+            size_t seq = cell.seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if(diff == 0) {
+                if(head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.task = std::move(task);
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if(diff < 0) {
+                // 槽仍未被读走：队列满
+                return false;
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // 出队，队列空时返回false
+    bool pop(Task &task) {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        while(true) {
+            Cell &cell = cells_[pos & mask_];
+            size_t seq = cell.seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if(diff == 0) {
+                if(tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    task = std::move(cell.task);
+                    cell.seq.store(pos + mask_ + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if(diff < 0) {
+                // 槽尚未写入：队列空
+                return false;
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        Task task;
+    };
+    static size_t roundUp_(size_t n) {
+        size_t size = 2;
+        while(size < n) {
+            size <<= 1;
+        }
+        return size;
+    }
+
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_;
+    char pad0_[64];  // 写位置和读位置分处不同的缓存行，避免生产者与消费者互相干扰
+    std::atomic<size_t> head_;  // 下一个写位置
+    char pad1_[64];
+    std::atomic<size_t> tail_;  // 下一个读位置
+    char pad2_[64];
+};
+
+/*  线程池：每个工作线程一个有界无锁队列，空闲时窃取其他线程的任务
+    post()：投递即忘，任务轮流投递到各线程的队列，不加锁、不分配内存；队列都满时返回false而不阻塞
+    空闲线程先自旋一段时间，仍没有任务才在条件变量上休眠；投递者只在有线程休眠时才加锁唤醒
+*/
 class ThreadPool {
 public:
-    ThreadPool(size_t threadNum) : isStop(false) {
-    for(size_t i = 0; i < threadNum; i++) {
-        // 向线程池中加入新开辟的线程
-        WorkThreads.emplace_back([this] {
-            while(true) {
-                std::function<void()> task;  // 创建一个封装void()函数的function类型的对象task，用于后续接收从任务队列中弹出的真实任务
-                {
-                    std::unique_lock<std::mutex> lock(this->m_mutex);
-                    // 当isStop==false&&tasks.empty()==1时当前线程阻塞，直至m_cond被通知
-                    this->m_cond.wait(lock, [this] {
-                        return this->isStop || !this->tasks.empty();});
-                    // 当isStop==true&&tasks.empty()==1时跳出死循环
-                    if(this->isStop && this->tasks.empty()) {
-                        return;
-                    }
-                    // 弹出工作队列中的最旧的任务
-                    task = std::move(this->tasks.front());
-                    this->tasks.pop();
+    static const size_t QUEUE_CAPACITY = 4096;  // 每个工作线程队列的容量
+    static const int SPIN_COUNT = 2000; // 休眠前自旋检查的次数(单核机器上不自旋：自旋只会推迟投递者运行)
+    static const int POST_RETRIES = 16; // 所有队列都满时post()重试的轮数
+
+    ThreadPool(size_t threadNum) : isStop(false), pending_(0), sleepers_(0), 
+        spinCount_(std::thread::hardware_concurrency() > 1 ? SPIN_COUNT : 0) {
+        if(threadNum < 1) {
+            threadNum = 1;
+        }
+        for(size_t i = 0; i < threadNum; i++) {
+            queues_.emplace_back(new TaskQueue(QUEUE_CAPACITY));
+        }
+        for(size_t i = 0; i < threadNum; i++) {
+            // 向线程池中加入新开辟的线程
+            WorkThreads.emplace_back([this, i] { work_(i); });
+        }
+    }
+
+    /*  添加任务到工作队列，不返回结果
+        所有队列都满时让出几次CPU等待工作线程消化，仍然满则放弃并返回false，由调用者决定拒绝还是自行处理
+    */
+    template <typename F>
+    bool post(F &&f) {
+        if(isStop.load(std::memory_order_relaxed)) {
+            throw std::runtime_error("threadpool already stopped, post failed");
+        }
+        Task task(std::forward<F>(f));
+        // 先计数再入队，工作线程看到的计数不小于实际任务数
+        pending_.fetch_add(1, std::memory_order_seq_cst);
+        // 每个投递线程各自轮流选择队列，满了就换下一个
+        static thread_local size_t next = 0;
+        size_t n = queues_.size();
+        for(int retry = 0; retry <= POST_RETRIES; retry++) {
+            for(size_t i = 0; i < n; i++) {
+                if(queues_[next++ % n]->push(task)) {
+                    wakeOne_();
+                    return true;
                 }
-                // 执行任务
-                task();
             }
-        });
+            // 所有队列都满，等待工作线程消化
+            wakeOne_();
+            std::this_thread::yield();
+        }
+        pending_.fetch_sub(1, std::memory_order_relaxed);
+        return false;
     }
-}
 
-    // 添加任务到工作队列
+    // 添加任务到工作队列，返回可获取结果的future(有额外的分配，热路径请用post)；队列满时一直等待，不要在reactor线程中调用
     template <typename F, typename... Args>
     auto enqueue(F &&f, Args &&...args) -> std::future<typename std::result_of<F(Args...)>::type> {
-    // 函数F(Args...)的返回类型，future<>用于访问异步操作的结果
-    using returnType = typename std::result_of<F(Args...)>::type;
-    // 创建智能指针task，指向一个用(bind())初始化的packaged_task<returnType()>类的对象
-    // 等同于packaged_task<returnType()> t(bind(forward<F>(f), forward<Args>(args)...))，将task指向t
-    // packaged_task<returnType()>包装了一个返回值为returnType的函数
-    // bind(f,a,b)捆绑了一个f(a,b)的函数
-    // forward完整保留参数的引用类型(左/右值引用)进行转发
-    auto task = std::make_shared<std::packaged_task<returnType()>> (
-        std::bind(std::forward<F>(f), std::forward<Args>(args)...)
-    );
-    // task异步执行完毕后将结果保存在res中
-    std::future<returnType> res = task->get_future();
-    {
-        std::unique_lock<std::mutex> lock(m_mutex);
-        if(isStop) {
-            throw std::runtime_error("threadpool already stopped, enqueue failed");
-        }
-        // 将task指向的f(args)插入工作队列中
-        // (*task)()即为f(args)
-        tasks.emplace([task]{(*task)();});
-    }
-    // 加入任务后，唤醒一个线程
-    m_cond.notify_one();
-    // 线程执行完毕后，将异步执行结果返回
-    return res;
-}
-    
+        using returnType = typename std::result_of<F(Args...)>::type;
+        auto task = std::make_shared<std::packaged_task<returnType()>> (
+            std::bind(std::forward<F>(f), std::forward<Args>(args)...)
+        );
+        std::future<returnType> res = task->get_future();
+        while(!post([task]{ (*task)(); })) {
+            std::this_thread::yield();
+        }
+        return res;
+    }
+
+    size_t pending() const { return pending_.load(std::memory_order_relaxed); };  // 排队中的任务数(近似值)
+
     ~ThreadPool() {
-    {
-        std::unique_lock<std::mutex> lock(m_mutex);
-        isStop = true;
-    }
-    // 条件变量唤醒所有线程，所有线程从37-38行向下执行
-    m_cond.notify_all();
-    // isStop==true&&tasks.empty()==1时，线程跳出while(true)循环
-    for(std::thread &worker : WorkThreads) {
-        // 每个线程都退出后，主线程再退出
-        worker.join();
-    }
-}
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            isStop = true;
+        }
+        // 唤醒所有线程，处理完剩余任务后退出
+        m_cond.notify_all();
+        for(std::thread &worker : WorkThreads) {
+            // 每个线程都退出后，主线程再退出
+            worker.join();
+        }
+    }
+
 private:
+    // 先取自己的队列，再依次窃取其他线程的队列
+    bool take_(size_t id, Task &task) {
+        size_t n = queues_.size();
+        for(size_t i = 0; i < n; i++) {
+            if(queues_[(id + i) % n]->pop(task)) {
+                pending_.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void wakeOne_() {
+        if(sleepers_.load(std::memory_order_seq_cst) > 0) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_cond.notify_one();
+        }
+    }
+
+    static void pause_() {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#else
+        std::this_thread::yield();
+#endif
+    }
+
+    void work_(size_t id) {
+        Task task;
+        while(true) {
+            bool found = take_(id, task);
+            for(int spin = 0; !found && spin < spinCount_; spin++) {
+                pause_();
+                found = take_(id, task);
+            }
+            if(found) {
+                // 执行任务
+                task();
+                task.reset();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(m_mutex);
+            // 当isStop==true&&没有任务时线程退出
+            if(isStop && pending_.load(std::memory_order_seq_cst) == 0) {
+                return;
+            }
+            // 先登记休眠再检查计数：投递者要么看到休眠者而唤醒，要么这里看到新计数而不休眠
+            sleepers_.fetch_add(1, std::memory_order_seq_cst);
+            m_cond.wait(lock, [this] {
+                return isStop || pending_.load(std::memory_order_seq_cst) > 0;});
+            sleepers_.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
     std::vector<std::thread> WorkThreads;   // 线程池
-    std::queue<std::function<void()>> tasks;  // 工作队列
-    std::mutex m_mutex;  // 工作队列的互斥锁
-    std::condition_variable m_cond;  // 工作队列的条件变量
-    bool isStop;    // 线程池是否关闭
+    std::vector<std::unique_ptr<TaskQueue>> queues_;  // 每个线程的工作队列
+    std::mutex m_mutex;  // 休眠用的互斥锁
+    std::condition_variable m_cond;  // 休眠用的条件变量
+    std::atomic<bool> isStop;    // 线程池是否关闭
+    std::atomic<size_t> pending_;   // 已投递未取出的任务数(可能暂时偏大)
+    std::atomic<int> sleepers_; // 休眠中的线程数
+    int spinCount_; // 休眠前自旋的次数
 };
 
 #endif
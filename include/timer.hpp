@@ -4,54 +4,98 @@
 #include <functional>
 #include <ctime>
 #include <chrono>
-#include <vector>
-#include <unordered_map>
+#include <cstdint>
+#include <unistd.h>
+#include <sys/timerfd.h>
 #include <assert.h>
 
-typedef std::chrono::high_resolution_clock CLOCK;
+typedef std::chrono::steady_clock CLOCK;
 typedef CLOCK::time_point TimeStamp;
 typedef std::chrono::milliseconds MS;
 typedef std::function<void()> TimeoutCallBack;
 
-// 定时器节点
-class TimerNode {
-public:
-    int id;  // 每个socket连接对应一个定时器
-    TimeStamp timeExpire;    // 过期时间
-    TimeoutCallBack callbackFunc;   // 回调函数用于删除定时器时关闭对应的HTTP连接
+// 侵入式双向链表的链接，时间轮的每个槽以一个链接作为哨兵，构成循环链表
+struct TimerLink {
+    TimerLink *prev = nullptr;
+    TimerLink *next = nullptr;
 
-    // 重载比较运算符<
-    bool operator< (const TimerNode& t) {
-        return timeExpire < t.timeExpire;
+    bool linked() const { return next != nullptr; };
+    void unlink() {
+        if(next) {
+            prev->next = next;
+            next->prev = prev;
+            prev = next = nullptr;
+        }
     }
 };
 
-// 管理定时器
+/*  定时器节点：嵌入在使用者(如HttpConn)中，添加、刷新和删除都不需要分配内存
+    节点析构时自动从时间轮中摘除
+*/
+class TimerNode : public TimerLink {
+public:
+    TimerNode() = default;
+    ~TimerNode() { unlink(); };
+    TimerNode(const TimerNode&) = delete;
+    TimerNode& operator=(const TimerNode&) = delete;
+
+    uint64_t expire = 0;    // 过期时间(ms，TimerManager的时钟)
+    TimeoutCallBack callbackFunc;   // 回调函数用于删除定时器时关闭对应的HTTP连接
+};
+
+/*  管理定时器：分层时间轮，精度1ms
+    第0层256个槽，每槽1ms；第1~3层各64个槽，每槽为上一层的一圈(256ms、16.4s、17.5min)，共可覆盖约18.6h
+    添加、刷新、删除都是O(1)的链表操作；第0层转完一圈时，把上层对应槽中的定时器重新分配到下层(cascade)
+    时钟在每轮事件循环中读取一次(tick)并缓存，添加和刷新定时器使用缓存的时间
+    到期通过timerfd通知：timerfd按最早的过期时间设置，并向上取整到slack的整数倍，相近的到期合并为一次唤醒；
+    事件循环只在timerfd可读时才处理定时器
+*/
 class TimerManager {
 public:
-    TimerManager() { heapTimer_.reserve(128); };  // reserve()只扩充capability，不改变size
-    ~TimerManager() { clear();};
+    TimerManager(int slackMS = 1);
+    ~TimerManager();
 
-    void addTimer(int id, int timewait, const TimeoutCallBack& cbfunc); // 添加定时器
+    void addTimer(TimerNode *node, int timewait, const TimeoutCallBack& cbfunc); // 添加定时器，节点已在时间轮中时重置
     void handleExpiredTimer();  // 处理超时的连接
     int getNextHandle();    // 下一次处理超时连接的时间
 
-    void update(size_t id, int timewait);  // 更新指定id的定时时长并调整节点
-    void work(size_t id);  // 删除指定id的定时器，触发回调函数
+    int getFd() const { return timerfd_; }; // timerfd，可读表示有定时器到期
+    void handleTimerEvent();    // timerfd可读：处理到期的定时器并重新设置timerfd
+
+    void update(TimerNode *node, int timewait);  // 更新节点的定时时长
+    void del(TimerNode *node);  // 删除定时器，不触发回调函数
+    void work(TimerNode *node);  // 删除定时器，触发回调函数
 
-    void pop(); // 弹出顶端到期的定时器节点
-    void clear();   // 清除堆和哈希表
+    void tick();    // 读取时钟，更新缓存的当前时间
+    uint64_t now() const { return now_; };  // 缓存的当前时间(ms)
+    size_t size() const { return count_; }; // 定时器数量
+    void clear();   // 摘除所有定时器
 
 private:
-    // 在vector基础上实现堆结构
-    void delTimer(size_t i);    // 删除指定的定时器
-    void siftup(size_t i);     // 比较父子节点的定时，i小,往上调
-    void siftdown(size_t i);   // 比较父子节点的定时，i大,往下调
-    void swapNode(size_t i, size_t j);  // 交换定时器节点
-
-    std::vector<TimerNode> heapTimer_;   // vector存储定时器，模拟堆
-    std::unordered_map<size_t, size_t> ref_; // 哈希表：key = id, value = index of Timer in heapTimer_
-    // 补充：ref_用于映射一个client fd对应的TimerNode在堆中的索引
+    static const int ROOT_BITS = 8;
+    static const int LEVEL_BITS = 6;
+    static const int LEVELS = 4;
+    static const uint64_t ROOT_SIZE = 1 << ROOT_BITS;
+    static const uint64_t LEVEL_SIZE = 1 << LEVEL_BITS;
+    static const uint64_t MAX_SPAN = (uint64_t)1 << (ROOT_BITS + (LEVELS - 1) * LEVEL_BITS);   // 时间轮能表示的最长定时
+
+    void place_(TimerNode *node);   // 按过期时间把节点放入对应的槽
+    void cascade_(int level);    // 把第level层当前槽的定时器重新分配到下层
+    void runSlot_(TimerLink *slot); // 触发一个槽中的所有定时器
+    static void append_(TimerLink *slot, TimerLink *link);    // 把节点挂到槽的链表尾
+    uint64_t nextExpire_() const;   // 下一个需要处理的时刻(定时器到期或cascade)，没有定时器时返回0
+    void arm_(uint64_t expire);   // 设置timerfd在expire(按slack取整后)触发
+    void rearm_();  // 按最早的过期时间重新设置timerfd
+
+    TimerLink root_[ROOT_SIZE];    // 第0层
+    TimerLink levels_[LEVELS - 1][LEVEL_SIZE];  // 第1~3层
+    uint64_t current_;  // 下一个待处理的时刻(ms)，此前的定时器都已触发
+    uint64_t now_;  // 缓存的当前时间(ms)
+    size_t count_;  // 定时器数量
+
+    int timerfd_;   // 到期通知
+    uint64_t slack_;   // 过期时间取整的粒度(ms)
+    uint64_t armed_;    // timerfd当前设置的时刻，0表示未设置
 };
 
 #endif
\ No newline at end of file
@@ -1,61 +1,121 @@
 #ifndef MY_WEB_SERVER_H
 #define MY_WEB_SERVER_H
 
-#include <unordered_map>
+#include <vector>
+#include <string>
+#include <thread>
+#include <memory>
+#include <atomic>
 #include <fcntl.h>
 #include <unistd.h>
 #include <assert.h>
 #include <errno.h>
+#include <signal.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
-#include "epoll.hpp"
+#include <netinet/tcp.h>
+#include "poller.hpp"
 #include "timer.hpp"
 #include "threadpool.hpp"
 #include "httpconnect.hpp"
+#include "connslab.hpp"
+#include "admission.hpp"
+#include "ratelimit.hpp"
+#include "metrics.hpp"
+#include "accesslog.hpp"
+
+// 监听套接字的选项
+struct ListenOptions {
+    int backlog = 1024; // 全连接队列长度(受net.core.somaxconn限制)
+    int deferAcceptSec = 0; // TCP_DEFER_ACCEPT：客户端发来数据(或超时)后才唤醒accept，0表示不开启
+    int fastOpenQueue = 0;  // TCP_FASTOPEN：尚未完成握手的TFO连接的队列长度，0表示不开启
+    /*  false：每个reactor一个SO_REUSEPORT监听套接字，由内核按四元组哈希分发新连接
+        true：所有reactor共用一个监听套接字，以EPOLLEXCLUSIVE注册，每个新连接只唤醒一个等待中的reactor
+    */
+    bool sharedListen = false;
+};
 
 class WebServer {
 public:
-    WebServer(int port, int trigMode, int timewaitMS, bool isLinger, int threadNum);
+    WebServer(int port, int trigMode, int timewaitMS, bool isLinger, int threadNum, int reactorNum = 1, int timerSlackMS = 10, 
+        bool runInline = false, Poller::Backend backend = Poller::EPOLL, const ListenOptions &listenOptions = ListenOptions(), 
+        const AdmissionOptions &admissionOptions = AdmissionOptions(), const RateLimitOptions &rateLimitOptions = RateLimitOptions(), 
+        const AccessLogOptions &accessLogOptions = AccessLogOptions());
     ~WebServer();
 
     void Start();   // 服务器开始运行
+    /*  内存报告：连接数、槽位表、缓冲区占用及平均每个连接的字节数，可在任意线程调用
+        空闲连接的请求和响应在空闲时已释放，不计入
+    */
+    std::string memoryReport() const;
 
 private:
-    bool initSocket_(); // 服务器socket初始化
+    /*  Reactor：一个事件循环线程
+        每个reactor独占一个事件后端实例、一个定时器、一部分连接，以及一个SO_REUSEPORT监听套接字(或共用的监听套接字)，
+        由内核在多个监听套接字之间分发新连接，reactor之间不共享任何连接状态
+    */
+    struct Reactor {
+        int id; // reactor编号，0号运行在主线程
+        int listenFd;   // 该reactor的监听套接字
+        std::unique_ptr<Poller> poller;  // 事件后端(epoll或io_uring)
+        std::unique_ptr<TimerManager> timer;   // 定时器
+        std::unique_ptr<ConnSlab> conns;   // 该reactor负责的client连接，按fd索引
+        std::thread thread; // 事件循环线程(0号reactor不使用)
+        /*  工作线程交回reactor处理的连接：无锁链表(栈)，节点嵌在槽位中，不分配内存
+            reactor每轮循环一次取走整条链表；只有reactor正阻塞在wait()中时投递者才调用poller->wakeup()唤醒它
+        */
+        std::atomic<ConnSlab::Slot *> pending;
+        std::atomic<bool> sleeping; // reactor是否(将要)阻塞在wait()中
+    };
+
+    bool initSocket_(Reactor *reactor); // 服务器socket初始化
     void initEventMode_(int trigMode);  // 设置不同套接字的触发模式
+    uint32_t listenEvents_() const; // 注册监听套接字的事件
+    void addProbes_();  // 向Metrics登记连接数、排队、拒绝次数、内存占用和访问日志的探针
+
+    void eventLoop_(Reactor *reactor);  // reactor的事件循环
 
-    void addClientConn_(int fd, sockaddr_in addr);   // 添加一个Http连接
-    void closeConn_(HttpConn *client);  // 关闭一个Http连接
+    void addClientConn_(Reactor *reactor, int fd, sockaddr_in addr, const RateLimiter::ConnToken &limitToken);   // 添加一个Http连接
+    void closeConn_(Reactor *reactor, HttpConn *client);  // 关闭一个Http连接，在工作线程中调用时交回reactor关闭
+    void rejectConn_(Reactor *reactor, HttpConn *client);  // 过载：发送503后关闭连接
 
-    void handleListen_();   // 监听套接字accept http连接，将连接加入epoll实例
-    void handleWrite_(HttpConn *client);
-    void handleRead_(HttpConn *client);
+    void handleListen_(Reactor *reactor);   // 监听套接字accept http连接，将连接加入事件后端
+    void handleWrite_(Reactor *reactor, HttpConn *client);
+    void handleRead_(Reactor *reactor, HttpConn *client);
 
-    void onRead_(HttpConn *client);
-    void onWrite_(HttpConn *client);
-    void onProcess_(HttpConn *client);
+    void onRead_(Reactor *reactor, HttpConn *client);
+    void onWrite_(Reactor *reactor, HttpConn *client);
+    void onProcess_(Reactor *reactor, HttpConn *client);
+    void onProcessInline_(Reactor *reactor, HttpConn *client);   // 运行至完成：在reactor线程中处理并直接发送
 
+    bool post_(Reactor *reactor, HttpConn *client, void (WebServer::*task)(Reactor *, HttpConn *));  // 交给线程池，记录排队时长；队列满时返回false
     void sendError_(int fd, const char* info);  // 发送错误
-    void extentTime_(HttpConn *client); // 更新定时器
+    void extentTime_(Reactor *reactor, HttpConn *client); // 更新定时器
+    void rearm_(Reactor *reactor, HttpConn *client, uint32_t events);   // 重新注册连接的oneshot事件
+    bool inReactor_(Reactor *reactor) const;   // 事件后端能否在当前线程中直接修改
+    void handoff_(Reactor *reactor, HttpConn *client, uint32_t events);  // 交给reactor线程重新注册，events为0时关闭连接
+    void handlePending_(Reactor *reactor);  // 处理工作线程交回的连接
 
     static const int MAX_FD = 65536;
-    
-    static int setFdNonblock(int fd);
+    static thread_local Reactor *current_;  // 当前线程运行的reactor，工作线程中为nullptr
 
     int port_;  // 端口
     int timewaitMS_;  // 定时器默认的过期时间
-    bool isClose_;  // 服务器是否关闭
-    int listenFd_;  // 监听套接字
+    int timerSlackMS_;  // 定时器到期的合并粒度
+    bool runInline_;    // 运行至完成模式：读、处理、写都在reactor线程中进行，只有较慢的请求交给线程池
+    std::atomic<bool> isClose_;  // 服务器是否关闭
     bool isLinger_; // 延时关闭
+    ListenOptions listenOptions_;   // 监听套接字的选项
     char *srcDir_;  // 需要获取的资源路径
 
     uint32_t listenEvent_;  // 监听事件
     uint32_t connectionEvent_;  // 连接事件
 
-    std::unique_ptr<TimerManager> timer_;   // 定时器
-    std::unique_ptr<ThreadPool> threadpool_;// 线程池
-    std::unique_ptr<Epoll> epoll_;  // Epoll实例
-    std::unordered_map<int, HttpConn> users_;   // client连接
+    std::unique_ptr<AccessLog> accessLog_;  // 访问日志(所有reactor共享)，在线程池和reactor之后释放，剩余的记录都能写出
+    std::unique_ptr<ThreadPool> threadpool_;// 线程池(所有reactor共享)，在析构函数中最先停止
+    std::unique_ptr<AdmissionControl> admission_;  // 准入控制(所有reactor共享)
+    std::unique_ptr<RateLimiter> rateLimiter_;  // 按客户端地址限流(所有reactor共享)
+    std::vector<std::unique_ptr<Reactor>> reactors_;  // 事件循环，每个线程一个
 };
 
 #endif
\ No newline at end of file
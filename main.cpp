@@ -8,9 +8,36 @@
     3：连接和监听都是ET
 */
 int main() {
+    ListenOptions listenOptions;
+    listenOptions.backlog = 1024;   // 全连接队列长度
+    listenOptions.deferAcceptSec = 5;   // 客户端发来请求数据后才唤醒accept
+    listenOptions.fastOpenQueue = 0;    // 不开启TCP Fast Open
+    listenOptions.sharedListen = false; // 每个reactor一个SO_REUSEPORT监听套接字
+
+    AdmissionOptions admissionOptions;
+    admissionOptions.maxConns = 60000;  // 连接数上限，超过后新连接回复503
+    admissionOptions.maxQueueDepth = 1024;  // 线程池排队任务数上限
+    admissionOptions.maxQueueDelayMS = 50;  // 排队时长上限
+    admissionOptions.retryAfterSec = 1; // 建议客户端1s后重试
+
+    RateLimitOptions rateLimitOptions;
+    rateLimitOptions.maxConnsPerIP = 0; // 每个IP的连接数上限，0不限制(压测时所有连接来自同一地址)
+    rateLimitOptions.maxConnsPerSubnet = 0; // 每个/24网段的连接数上限
+    rateLimitOptions.requestsPerSec = 0;    // 每个IP的请求速率，超出时回复429
+
+    AccessLogOptions accessLogOptions;
+    accessLogOptions.path = "./access.log"; // 访问日志，为空时不记录
+    accessLogOptions.rotateBytes = 64 << 20;    // 超过64MB轮转
+    accessLogOptions.rotateSec = 24 * 3600; // 每天轮转
+
     WebServer server(
         1316, 3, 60000, // client监听端口, ET触发模式, 连接定时1min
-        false, 4    // 关闭延时退出, 线程池中的线程数
+        false, 4,   // 关闭延时退出, 线程池中的线程数
+        4,  // reactor数量(每个reactor一个事件循环线程)
+        10, // 定时器到期的合并粒度10ms
+        true,   // 运行至完成：快速请求直接在reactor线程中处理
+        Poller::IO_URING,   // 事件后端：io_uring，内核不支持时退回epoll
+        listenOptions, admissionOptions, rateLimitOptions, accessLogOptions
     );
     server.Start();
 }
\ No newline at end of file
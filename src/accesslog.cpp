@@ -0,0 +1,262 @@
+#include "../include/accesslog.hpp"
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <ctime>
+#include <chrono>
+#include <algorithm>
+#include <arpa/inet.h>
+#include <sys/stat.h>
+#include "../include/metrics.hpp"
+
+const size_t AccessLog::METHOD_LEN;
+const size_t AccessLog::PATH_LEN;
+const size_t AccessLog::BATCH_BYTES;
+
+static std::atomic<uint64_t> nextLogId(1);
+
+void AccessLog::Record::set(uint32_t clientIP, const std::string &requestMethod, const std::string &requestPath,
+    int statusCode, size_t sentBytes, uint64_t startNS) {
+    start = startNS;
+    duration = 0;
+    bytes = sentBytes;
+    ip = clientIP;
+    status = statusCode;
+    methodLen = std::min(requestMethod.size(), METHOD_LEN);
+    memcpy(method, requestMethod.data(), methodLen);
+    pathLen = std::min(requestPath.size(), PATH_LEN);
+    memcpy(path, requestPath.data(), pathLen);
+}
+
+AccessLog::Ring::Ring(size_t capacity) : mask(capacity - 1), head(0), tail(0), dropped(0) {
+    records.reset(new Record[capacity]);
+}
+
+AccessLog::AccessLog(const AccessLogOptions &options)
+    : options_(options), id_(nextLogId.fetch_add(1)), enabled_(false), fd_(-1), fileBytes_(0), nextRotate_(0),
+    stop_(false), wake_(false), written_(0), writeDropped_(0), outRecords_(0), wallOffsetNS_(0), cachedSec_(-1) {
+    size_t size = 2;
+    while(size < options_.ringSize) {
+        size <<= 1;
+    }
+    options_.ringSize = size;
+    if(options_.flushMS <= 0) {
+        options_.flushMS = 200;
+    }
+    if(!options_.path.empty() && openFile_()) {
+        enabled_ = true;
+        out_.reserve(BATCH_BYTES + 1024);
+        thread_ = std::thread(&AccessLog::run_, this);
+    }
+}
+
+AccessLog::~AccessLog() {
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        stop_ = true;
+    }
+    cond_.notify_one();
+    if(thread_.joinable()) {
+        thread_.join();
+    }
+    if(fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+uint64_t AccessLog::dropped() const {
+    uint64_t n = writeDropped_.load(std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(mtx_);
+    for(const auto &ring : rings_) {
+        n += ring->dropped.load(std::memory_order_relaxed);
+    }
+    return n;
+}
+
+AccessLog::Ring &AccessLog::ring_() {
+    // 按实例编号而不是地址识别，新实例复用旧实例的地址时不会误用已释放的队列
+    static thread_local uint64_t owner = 0;
+    static thread_local Ring *ring = nullptr;
+    if(owner != id_) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        rings_.emplace_back(new Ring(options_.ringSize));
+        ring = rings_.back().get();
+        owner = id_;
+    }
+    return *ring;
+}
+
+void AccessLog::append(const Record &record) {
+    if(!enabled_) {
+        return;
+    }
+    Ring &ring = ring_();
+    size_t head = ring.head.load(std::memory_order_relaxed);
+    size_t used = head - ring.tail.load(std::memory_order_acquire);
+    if(used > ring.mask) {
+        // 队列满：后台线程跟不上(磁盘慢)，丢弃而不是等待
+        ring.dropped.store(ring.dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return;
+    }
+    ring.records[head & ring.mask] = record;
+    ring.head.store(head + 1, std::memory_order_release);
+    if(used == (ring.mask + 1) / 2 && !wake_.exchange(true, std::memory_order_relaxed)) {
+        // 队列过半，提前唤醒后台线程(每个周期最多唤醒一次)
+        cond_.notify_one();
+    }
+}
+
+void AccessLog::run_() {
+    std::vector<Ring *> rings;
+    bool stopping = false;
+    while(!stopping) {
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            cond_.wait_for(lock, std::chrono::milliseconds(options_.flushMS), [this] {
+                return stop_ || wake_.load(std::memory_order_relaxed);
+            });
+            wake_.store(false, std::memory_order_relaxed);
+            stopping = stop_;
+            rings.clear();
+            for(auto &ring : rings_) {
+                rings.push_back(ring.get());
+            }
+        }
+        updateClock_();
+        for(Ring *ring : rings) {
+            drain_(*ring);
+        }
+        flush_();
+    }
+}
+
+void AccessLog::drain_(Ring &ring) {
+    size_t tail = ring.tail.load(std::memory_order_relaxed);
+    size_t head = ring.head.load(std::memory_order_acquire);
+    while(tail != head) {
+        format_(ring.records[tail & ring.mask]);
+        tail++;
+        if(out_.size() >= BATCH_BYTES) {
+            // 先归还已格式化的槽位，再写出
+            ring.tail.store(tail, std::memory_order_release);
+            flush_();
+        }
+    }
+    ring.tail.store(tail, std::memory_order_release);
+}
+
+void AccessLog::updateClock_() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    int64_t wall = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    wallOffsetNS_ = wall - (int64_t)Metrics::now();
+}
+
+void AccessLog::format_(const Record &record) {
+    int64_t wall = (int64_t)record.start + wallOffsetNS_;
+    int64_t sec = wall / 1000000000;
+    if(sec != cachedSec_) {
+        // 同一秒内的记录复用格式化结果
+        time_t t = sec;
+        struct tm tm;
+        gmtime_r(&t, &tm);
+        strftime(dateCache_, sizeof(dateCache_), "%Y-%m-%dT%H:%M:%S", &tm);
+        cachedSec_ = sec;
+    }
+    char ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &record.ip, ip, sizeof(ip));
+
+    char line[96 + sizeof(dateCache_) + INET_ADDRSTRLEN];
+    int len = snprintf(line, sizeof(line), "%s [%s.%03dZ] \"", ip, dateCache_, (int)(wall / 1000000 % 1000));
+    out_.append(line, len);
+    // 方法和路径中不含控制字符和空格(解析时已检查)，只需转义引号和反斜杠
+    if(record.methodLen > 0) {
+        out_.append(record.method, record.methodLen);
+    } else {
+        out_ += '-';
+    }
+    out_ += ' ';
+    if(record.pathLen == 0) {
+        out_ += '-';
+    }
+    for(size_t i = 0; i < record.pathLen; i++) {
+        char c = record.path[i];
+        if(c == '"' || c == '\\') {
+            out_ += '\\';
+        }
+        out_ += c;
+    }
+    len = snprintf(line, sizeof(line), "\" %u %llu %.6f\n", (unsigned)record.status,
+        (unsigned long long)record.bytes, record.duration * 1e-9);
+    out_.append(line, len);
+    outRecords_++;
+}
+
+void AccessLog::flush_() {
+    if(out_.empty()) {
+        return;
+    }
+    int64_t now = (int64_t)time(nullptr);
+    if((options_.rotateBytes > 0 && fileBytes_ > 0 && fileBytes_ + out_.size() > options_.rotateBytes) ||
+        (nextRotate_ > 0 && now >= nextRotate_)) {
+        rotate_();
+    }
+    size_t written = 0;
+    while(fd_ >= 0 && written < out_.size()) {
+        ssize_t len = write(fd_, out_.data() + written, out_.size() - written);
+        if(len < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        written += len;
+    }
+    fileBytes_ += written;
+    if(written == out_.size()) {
+        written_.fetch_add(outRecords_, std::memory_order_relaxed);
+    } else {
+        // 写失败(如磁盘已满)：丢弃这一批
+        writeDropped_.fetch_add(outRecords_, std::memory_order_relaxed);
+    }
+    out_.clear();
+    outRecords_ = 0;
+}
+
+bool AccessLog::openFile_() {
+    fd_ = open(options_.path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if(fd_ < 0) {
+        return false;
+    }
+    struct stat st;
+    fileBytes_ = fstat(fd_, &st) == 0 ? st.st_size : 0;
+    if(options_.rotateSec > 0) {
+        // 按UTC对齐，如每天0点轮转
+        int64_t now = (int64_t)time(nullptr);
+        nextRotate_ = (now / options_.rotateSec + 1) * options_.rotateSec;
+    }
+    return true;
+}
+
+void AccessLog::rotate_() {
+    if(fileBytes_ > 0) {
+        time_t t = time(nullptr);
+        struct tm tm;
+        gmtime_r(&t, &tm);
+        char suffix[32];
+        strftime(suffix, sizeof(suffix), ".%Y%m%d-%H%M%S", &tm);
+        std::string rotated = options_.path + suffix;
+        // 同一秒内多次轮转时加序号
+        for(int i = 1; access(rotated.c_str(), F_OK) == 0; i++) {
+            rotated = options_.path + suffix + "." + std::to_string(i);
+        }
+        rename(options_.path.c_str(), rotated.c_str());
+    }
+    int oldFd = fd_;
+    if(!openFile_()) {
+        // 新文件打不开时继续写旧文件
+        fd_ = oldFd;
+        return;
+    }
+    close(oldFd);
+}
\ No newline at end of file
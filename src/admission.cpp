@@ -0,0 +1,45 @@
+#include "../include/admission.hpp"
+
+AdmissionControl::AdmissionControl(const AdmissionOptions &options) 
+    : options_(options), delayUS_(0), rejected_(0) {
+    const std::string body = "Service Unavailable\n";
+    response_ = "HTTP/1.1 503 Service Unavailable\r\n"
+        "Retry-After: " + std::to_string(options_.retryAfterSec > 0 ? options_.retryAfterSec : 1) + "\r\n"
+        "Content-Type: text/plain\r\n"
+        "Content-Length: " + std::to_string(body.size()) + "\r\n"
+        "Connection: close\r\n\r\n" + body;
+}
+
+bool AdmissionControl::admitConn(int conns) const {
+    return options_.maxConns <= 0 || conns < options_.maxConns;
+}
+
+bool AdmissionControl::admitRequest(size_t queueDepth) const {
+    if(options_.maxQueueDepth > 0 && queueDepth >= options_.maxQueueDepth) {
+        return false;
+    }
+    if(options_.maxQueueDelayMS > 0 && queueDepth > 0 && 
+        queueDelayUS() > static_cast<uint64_t>(options_.maxQueueDelayMS) * 1000) {
+        return false;
+    }
+    return true;
+}
+
+void AdmissionControl::recordQueueDelay(uint64_t us) {
+    // 指数平滑(权重1/8)；多个工作线程并发更新时偶尔丢失一个样本，不影响判断
+    uint64_t delay = delayUS_.load(std::memory_order_relaxed);
+    delay = delay - delay / 8 + us / 8;
+    delayUS_.store(delay, std::memory_order_relaxed);
+}
+
+void AdmissionControl::sendReject(int fd) {
+    reply(fd, response_);
+    rejected_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void AdmissionControl::reply(int fd, const std::string &response) {
+    // 先读掉已到达的数据：带着未读数据close()时内核发送RST，客户端可能收不到响应
+    char buf[4096];
+    for(int i = 0; i < 4 && recv(fd, buf, sizeof(buf), MSG_DONTWAIT) > 0; i++) {}
+    send(fd, response.data(), response.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+}
\ No newline at end of file
@@ -1,65 +1,184 @@
 #include "../include/buffer.hpp"
 
-Buffer::Buffer(int initBufferSize) 
-    : buffer_(initBufferSize), readPos_(0), writePos_(0) {}
+const size_t Buffer::CHUNK_SIZE;
+
+Buffer::Buffer(int chunkSize) 
+    : head_(0), chunkSize_(chunkSize > 0 ? chunkSize : CHUNK_SIZE), readable_(0) {}
+
+Buffer::~Buffer() {
+    Release();
+}
+
+Buffer::Buffer(Buffer &&other) 
+    : chunks_(std::move(other.chunks_)), head_(other.head_), chunkSize_(other.chunkSize_), readable_(other.readable_) {
+    other.chunks_.clear();
+    other.head_ = 0;
+    other.readable_ = 0;
+}
 
-// 可读的字节 = 写位置 - 读位置
 size_t Buffer::readableBytes() const {
-    return writePos_ - readPos_;
+    return readable_;
 }
 
-// 可写的字节 = buffer总长 - 写位置
+// 尾块中剩余的空间
 size_t Buffer::writeableBytes() const {
-    return buffer_.size() - writePos_;
+    if(chunks_.empty()) {
+        return 0;
+    }
+    return chunks_.back().capacity - chunks_.back().writePos;
 }
 
-// readPos_之前的容器空间可用
 size_t Buffer::prependableBytes() const {
-    return readPos_;
+    return chunks_.empty() ? 0 : chunks_[head_].readPos;
+}
+
+size_t Buffer::contiguousBytes() const {
+    return chunks_.empty() ? 0 : chunks_[head_].writePos - chunks_[head_].readPos;
+}
+
+size_t Buffer::capacity() const {
+    size_t capacity = 0;
+    for(size_t i = head_; i < chunks_.size(); i++) {
+        capacity += chunks_[i].capacity;
+    }
+    return capacity;
 }
 
 const char * Buffer::curReadPtr() const {
-    return BeginPtr_() + readPos_;
+    return chunks_.empty() ? nullptr : chunks_[head_].data + chunks_[head_].readPos;
 }
 
 const char *Buffer::curWritePtrConst() const {
-    return BeginPtr_() + writePos_;
+    return chunks_.empty() ? nullptr : chunks_.back().data + chunks_.back().writePos;
 }
 
 char *Buffer::curWritePtr() {
-    return BeginPtr_() + writePos_;
+    return chunks_.empty() ? nullptr : chunks_.back().data + chunks_.back().writePos;
 }
 
-char *Buffer::BeginPtr_() {
-    return &*buffer_.begin();
+void Buffer::AddChunk_(size_t len) {
+    if(!chunks_.empty() && chunks_.back().readPos == chunks_.back().writePos) {
+        // 尾块是空的(容纳不下len)，换成新块，保证链中除唯一的块外没有空块
+        BufferPool::instance().release(chunks_.back().data, chunks_.back().capacity);
+        chunks_.pop_back();
+    }
+    Chunk chunk = {nullptr, 0, 0, 0};
+    chunk.data = BufferPool::instance().acquire(std::max(len, chunkSize_), &chunk.capacity);
+    chunks_.push_back(chunk);
 }
 
-const char *Buffer::BeginPtr_() const {
-    return &*buffer_.begin();
+void Buffer::PopChunk_() {
+    BufferPool::instance().release(chunks_[head_].data, chunks_[head_].capacity);
+    head_++;
+    if(head_ == chunks_.size()) {
+        chunks_.clear();
+        head_ = 0;
+    } else if(head_ * 2 >= chunks_.size()) {
+        // 已归还的块占到一半时才整体前移，移动的元素不多于弹出的次数
+        chunks_.erase(chunks_.begin(), chunks_.begin() + head_);
+        head_ = 0;
+    }
 }
 
 void Buffer::Retrieve(size_t len) {
     assert(len <= readableBytes());
-    readPos_ += len;
+    readable_ -= len;
+    while(len > 0) {
+        Chunk &chunk = chunks_[head_];
+        size_t n = std::min(len, chunk.writePos - chunk.readPos);
+        chunk.readPos += n;
+        len -= n;
+        if(chunk.readPos == chunk.writePos) {
+            if(chunks_.size() - head_ > 1) {
+                // 读完的块立即归还
+                PopChunk_();
+            } else {
+                // 唯一的块读完，从头复用
+                chunk.readPos = chunk.writePos = 0;
+            }
+        }
+    }
 }
 
 void Buffer::RetrieveUntill(const char *end) {
-    assert(curReadPtr() <= end);
+    assert(curReadPtr() <= end && end <= curReadPtr() + contiguousBytes());
     Retrieve(end - curReadPtr());
 }
 
 void Buffer::RetrieveAll() {
-    bzero(&buffer_[0], buffer_.size());
-    readPos_ = 0;
-    writePos_ = 0;
+    // 保留首块供后续复用，其余归还
+    while(chunks_.size() - head_ > 1) {
+        BufferPool::instance().release(chunks_.back().data, chunks_.back().capacity);
+        chunks_.pop_back();
+    }
+    if(head_ > 0) {
+        chunks_.erase(chunks_.begin(), chunks_.begin() + head_);
+        head_ = 0;
+    }
+    if(!chunks_.empty()) {
+        chunks_[head_].readPos = chunks_[head_].writePos = 0;
+    }
+    readable_ = 0;
+}
+
+void Buffer::Release() {
+    for(size_t i = head_; i < chunks_.size(); i++) {
+        BufferPool::instance().release(chunks_[i].data, chunks_[i].capacity);
+    }
+    std::vector<Chunk>().swap(chunks_);
+    head_ = 0;
+    readable_ = 0;
+}
+
+std::string Buffer::RetrieveToString(size_t len) {
+    assert(len <= readableBytes());
+    std::string str;
+    str.reserve(len);
+    for(size_t i = head_; i < chunks_.size(); i++) {
+        const Chunk &chunk = chunks_[i];
+        if(str.size() == len) {
+            break;
+        }
+        size_t n = std::min(len - str.size(), chunk.writePos - chunk.readPos);
+        str.append(chunk.data + chunk.readPos, n);
+    }
+    Retrieve(len);
+    return str;
 }
 
 std::string Buffer::RetrieveAllToString() {
-    std::string str(curReadPtr(), readableBytes());
+    std::string str = RetrieveToString(readableBytes());
     RetrieveAll();
     return str;
 }
 
+void Buffer::Pullup(size_t len) {
+    assert(len <= readableBytes());
+    if(contiguousBytes() >= len) {
+        return;
+    }
+    // 跨块的数据拷贝到一个新块中，挂在链首
+    Chunk head = {nullptr, 0, 0, len};
+    head.data = BufferPool::instance().acquire(std::max(len, chunkSize_), &head.capacity);
+    size_t copied = 0;
+    while(copied < len) {
+        Chunk &chunk = chunks_[head_];
+        size_t n = std::min(len - copied, chunk.writePos - chunk.readPos);
+        std::copy(chunk.data + chunk.readPos, chunk.data + chunk.readPos + n, head.data + copied);
+        chunk.readPos += n;
+        copied += n;
+        if(chunk.readPos == chunk.writePos) {
+            PopChunk_();
+        }
+    }
+    if(head_ > 0) {
+        // 链首前有已归还的位置，直接放入
+        chunks_[--head_] = head;
+    } else {
+        chunks_.insert(chunks_.begin(), head);
+    }
+}
+
 // str.data()返回指向str的const void*类型指针
 void Buffer::Append(const std::string &str) {
     Append(str.data(), str.length());
@@ -72,73 +191,124 @@ void Buffer::Append(const void *data, size_t len) {
 
 void Buffer::Append(const char *str, size_t len) {
     assert(str);
-    EnsureWriteable(len);   // len个字节的数据可写入
-    std::copy(str, str + len, curWritePtr()); // 追加数据
-    UpdateWritePtr(len);
+    // 先填满尾块，不够时挂新块，已有数据不移动
+    while(len > 0) {
+        if(writeableBytes() == 0) {
+            AddChunk_(chunkSize_);
+        }
+        Chunk &tail = chunks_.back();
+        size_t n = std::min(len, tail.capacity - tail.writePos);
+        std::copy(str, str + n, tail.data + tail.writePos); // 追加数据
+        tail.writePos += n;
+        readable_ += n;
+        str += n;
+        len -= n;
+    }
 };
     
 void Buffer::Append(const Buffer &buffer) {
-    Append(buffer.curReadPtr(), buffer.readableBytes());
+    for(size_t i = buffer.head_; i < buffer.chunks_.size(); i++) {
+        const Chunk &chunk = buffer.chunks_[i];
+        Append(chunk.data + chunk.readPos, chunk.writePos - chunk.readPos);
+    }
 }
 
-// 可写字节数<待写字节长度，需要增加空间
+// 尾块可写字节数<待写字节长度，挂一个新块
 void Buffer::EnsureWriteable(size_t len) {
     if(writeableBytes() < len) {
-        MakeSpace(len);
+        AddChunk_(len);
     }
     assert(writeableBytes() >= len);
 }
 
 void Buffer::UpdateWritePtr(size_t len) {
-    writePos_ += len;
+    assert(len <= writeableBytes());
+    chunks_.back().writePos += len;
+    readable_ += len;
 }
 
-void Buffer::MakeSpace(size_t len) {
-    if(writeableBytes() + prependableBytes() < len) {
-        buffer_.resize(writePos_ + len + 1);
-    } else {
-        // 把已读数据向头部移动，为后续数据腾出空间
-        size_t readable = readableBytes();
-        std::copy(BeginPtr_() + readPos_, BeginPtr_() + writePos_, BeginPtr_());
-        readPos_ = 0;
-        writePos_ = readPos_ + readable;
-        assert(readable == readableBytes());
+int Buffer::PeekIov(size_t offset, size_t len, struct iovec *iov, int maxIov, size_t *exported) const {
+    int iovCnt = 0;
+    size_t done = 0;
+    for(size_t i = head_; i < chunks_.size(); i++) {
+        const Chunk &chunk = chunks_[i];
+        if(done == len || iovCnt == maxIov) {
+            break;
+        }
+        size_t avail = chunk.writePos - chunk.readPos;
+        if(offset >= avail) {
+            // 跳过offset之前的块
+            offset -= avail;
+            continue;
+        }
+        size_t n = std::min(avail - offset, len - done);
+        iov[iovCnt].iov_base = chunk.data + chunk.readPos + offset;
+        iov[iovCnt++].iov_len = n;
+        done += n;
+        offset = 0;
     }
+    *exported = done;
+    return iovCnt;
 }
 
 ssize_t Buffer::ReadFd(int fd, int *saveErrno) {
-    char stackbuffer[65535]; // 栈上的临时数组   
-    struct iovec iov[2];    // vector I/O
+    /*  iov[0]对应尾块中可写的部分，其余对应新申请的块，数据直接读入块中，不经过栈上的临时数组
+        尾块剩余不到半块时才申请新块；新块的个数随已缓存的数据增长，大的请求体每次readv读得更多；没有用到的新块读完后归还
+    */
+    struct iovec iov[MAX_READ_CHUNKS + 1];
+    Chunk fresh[MAX_READ_CHUNKS];
+    int iovCnt = 0;
     const size_t writeable = writeableBytes();
+    if(writeable > 0) {
+        iov[iovCnt].iov_base = chunks_.back().data + chunks_.back().writePos;
+        iov[iovCnt++].iov_len = writeable;
+    }
+    int freshCnt = std::min<size_t>(MAX_READ_CHUNKS, readable_ / chunkSize_ + (writeable < chunkSize_ / 2 ? 1 : 0));
+    for(int i = 0; i < freshCnt; i++) {
+        fresh[i].data = BufferPool::instance().acquire(chunkSize_, &fresh[i].capacity);
+        fresh[i].readPos = fresh[i].writePos = 0;
+        iov[iovCnt].iov_base = fresh[i].data;
+        iov[iovCnt++].iov_len = fresh[i].capacity;
+    }
 
-    // 2个IO口：iov[0]对应缓冲区buffer中可写的后面一部分，iov[1]对应栈上的临时数组
-    iov[0].iov_base = BeginPtr_() + writePos_;
-    iov[0].iov_len = writeable;
-    iov[1].iov_base = stackbuffer;
-    iov[1].iov_len = sizeof(stackbuffer);
-
-    // buffer_中空间够用，则使用iov[0]; 不够用，则使用iov[1]
-    const ssize_t len = readv(fd, iov, 2);
+    const ssize_t len = readv(fd, iov, iovCnt);
     if(len < 0) {
         *saveErrno = errno;
-    } else if(static_cast<size_t>(len) <= writeable) {
-        // buffer_足够用，writePos_右移len
-        writePos_ += len;
-    } else {
-        // buffer_不够用，writePos_移至最右端，把buffer_扩容，将栈中数据追加到buffer_中
-        writePos_ = buffer_.size();
-        Append(stackbuffer, len - writeable);
+    }
+    size_t left = len > 0 ? len : 0;
+    readable_ += left;
+    if(writeable > 0) {
+        size_t n = std::min(left, writeable);
+        chunks_.back().writePos += n;
+        left -= n;
+    }
+    for(int i = 0; i < freshCnt; i++) {
+        if(left == 0) {
+            BufferPool::instance().release(fresh[i].data, fresh[i].capacity);
+            continue;
+        }
+        fresh[i].writePos = std::min(left, fresh[i].capacity);
+        left -= fresh[i].writePos;
+        if(!chunks_.empty() && chunks_.back().readPos == chunks_.back().writePos) {
+            // 空的尾块(没有可写空间或尚未写入)换成新块
+            BufferPool::instance().release(chunks_.back().data, chunks_.back().capacity);
+            chunks_.pop_back();
+        }
+        chunks_.push_back(fresh[i]);
     }
     return len;
 };
 
 ssize_t Buffer::WriteFd(int fd, int *saveErrno) {
-    size_t readable = readableBytes();
-    ssize_t len = write(fd, curReadPtr(), readable);
+    // 各块导出为iovec，不拼接成连续内存
+    struct iovec iov[64];
+    size_t exported;
+    int iovCnt = PeekIov(0, readableBytes(), iov, 64, &exported);
+    ssize_t len = writev(fd, iov, iovCnt);
     if(len < 0) {
         *saveErrno = errno;
         return len;
     }
-    readPos_ += len;
+    Retrieve(len);
     return len;
 }
\ No newline at end of file
@@ -0,0 +1,93 @@
+#include "../include/bufferpool.hpp"
+
+const size_t BufferPool::MIN_BLOCK;
+const size_t BufferPool::MAX_CACHED_BYTES;
+
+BufferPool &BufferPool::instance() {
+    static BufferPool pool;
+    return pool;
+}
+
+BufferPool::LocalCache &BufferPool::local_() {
+    static thread_local LocalCache cache;
+    return cache;
+}
+
+BufferPool::LocalCache::~LocalCache() {
+    BufferPool &pool = BufferPool::instance();
+    for(int cls = 0; cls < CLASSES; cls++) {
+        pool.flush_(cls, *this, count[cls]);
+    }
+}
+
+int BufferPool::classOf_(size_t size) {
+    int cls = 0;
+    while(classSize_(cls) < size) {
+        if(++cls == CLASSES) {
+            return -1;
+        }
+    }
+    return cls;
+}
+
+char *BufferPool::acquire(size_t size, size_t *capacity) {
+    int cls = classOf_(size);
+    if(cls < 0) {
+        // 超大块不经过池
+        *capacity = size;
+        inUse_.fetch_add(size, std::memory_order_relaxed);
+        return static_cast<char*>(malloc(size));
+    }
+    *capacity = classSize_(cls);
+    inUse_.fetch_add(*capacity, std::memory_order_relaxed);
+    LocalCache &cache = local_();
+    if(cache.count[cls] == 0) {
+        refill_(cls, cache);
+    }
+    if(cache.count[cls] > 0) {
+        return cache.blocks[cls][--cache.count[cls]];
+    }
+    return static_cast<char*>(malloc(*capacity));
+}
+
+void BufferPool::release(char *block, size_t capacity) {
+    if(!block) {
+        return;
+    }
+    inUse_.fetch_sub(capacity, std::memory_order_relaxed);
+    int cls = classOf_(capacity);
+    if(cls < 0 || classSize_(cls) != capacity) {
+        free(block);
+        return;
+    }
+    LocalCache &cache = local_();
+    if(cache.count[cls] == LOCAL_MAX) {
+        flush_(cls, cache, BATCH);
+    }
+    cache.blocks[cls][cache.count[cls]++] = block;
+}
+
+void BufferPool::refill_(int cls, LocalCache &cache) {
+    FreeList &list = lists_[cls];
+    std::lock_guard<std::mutex> lock(list.mtx);
+    while(cache.count[cls] < BATCH && !list.blocks.empty()) {
+        cache.blocks[cls][cache.count[cls]++] = list.blocks.back();
+        list.blocks.pop_back();
+        cached_.fetch_sub(classSize_(cls), std::memory_order_relaxed);
+    }
+}
+
+void BufferPool::flush_(int cls, LocalCache &cache, int n) {
+    FreeList &list = lists_[cls];
+    std::lock_guard<std::mutex> lock(list.mtx);
+    for(int i = 0; i < n && cache.count[cls] > 0; i++) {
+        char *block = cache.blocks[cls][--cache.count[cls]];
+        if(list.blocks.size() * classSize_(cls) >= MAX_CACHED_BYTES) {
+            // 缓存已满，还给系统
+            free(block);
+            continue;
+        }
+        list.blocks.push_back(block);
+        cached_.fetch_add(classSize_(cls), std::memory_order_relaxed);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,56 @@
+#include "../include/connslab.hpp"
+
+ConnSlab::ConnSlab(int capacity) : capacity_(capacity), chunks_((capacity + CHUNK_SIZE - 1) / CHUNK_SIZE), 
+    bytes_(chunks_.size() * sizeof(chunks_[0])) {
+    assert(capacity > 0);
+}
+
+ConnSlab::~ConnSlab() {
+    for(auto &chunk : chunks_) {
+        if(!chunk) {
+            continue;
+        }
+        for(int i = 0; i < CHUNK_SIZE; i++) {
+            delete chunk[i].conn;
+        }
+    }
+}
+
+ConnSlab::Slot *ConnSlab::open(int fd) {
+    if(fd < 0 || fd >= capacity_) {
+        return nullptr;
+    }
+    std::unique_ptr<Slot[]> &chunk = chunks_[fd >> CHUNK_BITS];
+    if(!chunk) {
+        chunk.reset(new Slot[CHUNK_SIZE]());
+        bytes_.fetch_add(CHUNK_SIZE * sizeof(Slot), std::memory_order_relaxed);
+    }
+    Slot &slot = chunk[fd & (CHUNK_SIZE - 1)];
+    if(!slot.conn) {
+        slot.conn = new HttpConn();
+        bytes_.fetch_add(sizeof(HttpConn), std::memory_order_relaxed);
+    }
+    if(++slot.gen == 0) {
+        // 代数回绕时跳过0
+        slot.gen = 1;
+    }
+    return &slot;
+}
+
+ConnSlab::Slot *ConnSlab::find(uint64_t token) {
+    int fd = tokenFd(token);
+    if(fd < 0 || fd >= capacity_ || !chunks_[fd >> CHUNK_BITS]) {
+        return nullptr;
+    }
+    Slot &slot = chunks_[fd >> CHUNK_BITS][fd & (CHUNK_SIZE - 1)];
+    if(slot.gen != (uint32_t)(token >> 32) || slot.gen == 0) {
+        // fd已被新连接复用，或从未使用
+        return nullptr;
+    }
+    return &slot;
+}
+
+ConnSlab::Slot &ConnSlab::at(int fd) {
+    assert(fd >= 0 && fd < capacity_ && chunks_[fd >> CHUNK_BITS]);
+    return chunks_[fd >> CHUNK_BITS][fd & (CHUNK_SIZE - 1)];
+}
\ No newline at end of file
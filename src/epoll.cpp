@@ -1,30 +1,34 @@
 #include "../include/epoll.hpp"
 
-Epoll::Epoll(int maxEvent) : epollfd_(epoll_create(1)), events_(maxEvent) {
-    assert(epollfd_ >= 0 && events_.size() > 0);
+const uint64_t Epoll::WAKE_TAG;
+
+Epoll::Epoll(int maxEvent) : epollfd_(epoll_create(1)), wakeFd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)), events_(maxEvent) {
+    assert(epollfd_ >= 0 && wakeFd_ >= 0 && events_.size() > 0);
+    addFd(wakeFd_, EPOLLIN, WAKE_TAG);
 }
 
 Epoll::~Epoll() {
+    close(wakeFd_);
     close(epollfd_);
 }
 
-bool Epoll::addFd(int fd, uint32_t events) {
+bool Epoll::addFd(int fd, uint32_t events, uint64_t data) {
     if(fd < 0) {
         return false;
     }
     struct epoll_event ev = {0};
-    ev.data.fd = fd;
+    ev.data.u64 = data;
     ev.events = events;
     int ret = epoll_ctl(epollfd_, EPOLL_CTL_ADD, fd, &ev);
     return ret == 0;
 }
 
-bool Epoll::modFd(int fd, uint32_t events) {
+bool Epoll::modFd(int fd, uint32_t events, uint64_t data) {
     if(fd < 0) {
         return false;
     }
     epoll_event ev = {0};
-    ev.data.fd = fd;
+    ev.data.u64 = data;
     ev.events = events;
     int ret = epoll_ctl(epollfd_, EPOLL_CTL_MOD, fd, &ev);
     return ret == 0;
@@ -40,12 +44,28 @@ bool Epoll::rmFd(int fd) {
 
 int Epoll::wait(int timeMS) {
     int ret = epoll_wait(epollfd_, &events_[0], static_cast<int>(events_.size()), timeMS);
+    for(int i = 0; i < ret; i++) {
+        if(events_[i].data.u64 == WAKE_TAG) {
+            // 唤醒事件不交给调用者：清空eventfd，用最后一个事件填补
+            uint64_t count;
+            ssize_t n = read(wakeFd_, &count, sizeof(count));
+            (void)n;
+            events_[i] = events_[--ret];
+            break;
+        }
+    }
     return ret; 
 }
 
-int Epoll::getEventFd(size_t i) const {
+void Epoll::wakeup() {
+    uint64_t one = 1;
+    ssize_t n = write(wakeFd_, &one, sizeof(one));
+    (void)n;
+}
+
+uint64_t Epoll::getEventData(size_t i) const {
     assert(i >= 0 && i < events_.size());
-    return events_[i].data.fd;
+    return events_[i].data.u64;
 }
 
 uint32_t Epoll::getEvents(size_t i) const {
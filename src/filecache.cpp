@@ -0,0 +1,221 @@
+#include "../include/filecache.hpp"
+#include <iterator>
+
+const size_t FileCache::DEFAULT_CAPACITY;
+const int FileCache::REVALIDATE_MS;
+const size_t FileCache::MMAP_MAX;
+const size_t FileCache::DEFAULT_MAX_FDS;
+const int FileCache::SHARDS;
+
+FileCache &FileCache::instance() {
+    static FileCache cache;
+    return cache;
+}
+
+bool FileCache::sameFile_(const struct stat &a, const struct stat &b) {
+    return a.st_ino == b.st_ino && a.st_dev == b.st_dev && a.st_size == b.st_size
+        && a.st_mtim.tv_sec == b.st_mtim.tv_sec && a.st_mtim.tv_nsec == b.st_mtim.tv_nsec;
+}
+
+int FileCache::check_(const struct stat &st) {
+    if(S_ISDIR(st.st_mode)) {
+        return EISDIR;
+    }
+    if(!(st.st_mode & S_IROTH)) {
+        // 其他人对文件没有读权限
+        return EACCES;
+    }
+    return 0;
+}
+
+int FileCache::load_(const std::string &path, FilePtr *file) {
+    struct stat st;
+    if(stat(path.data(), &st) < 0) {
+        return errno;
+    }
+    int err = check_(st);
+    if(err != 0) {
+        return err;
+    }
+
+    int fd = open(path.data(), O_RDONLY);
+    if(fd < 0) {
+        return errno;
+    }
+    if(static_cast<size_t>(st.st_size) > MMAP_MAX) {
+        // 大文件保留fd，由sendfile在内核中直接发送
+        file->reset(new MappedFile(path, st, nullptr, fd));
+        return 0;
+    }
+    char *addr = nullptr;
+    if(st.st_size > 0) {
+        // 只读共享映射，所有连接共用同一份页缓存
+        void *mmapAddr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if(mmapAddr == MAP_FAILED) {
+            int err = errno;
+            close(fd);
+            return err;
+        }
+        addr = static_cast<char*>(mmapAddr);
+    }
+    close(fd);
+    file->reset(new MappedFile(path, st, addr, -1));
+    return 0;
+}
+
+bool FileCache::fresh_(const MappedFile &file, Clock::time_point now) {
+    Clock::time_point checkedAt(Clock::duration(file.checkedAt.load(std::memory_order_relaxed)));
+    return now - checkedAt < std::chrono::milliseconds(REVALIDATE_MS);
+}
+
+bool FileCache::hit_(Shard &shard, const std::string &path, FilePtr *file) {
+    {
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        auto it = shard.entries.find(path);
+        if(it == shard.entries.end()) {
+            return false;
+        }
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lru);
+        *file = it->second.file;
+    }
+    Clock::time_point now = Clock::now();
+    if(fresh_(**file, now)) {
+        return true;
+    }
+    // 到达检查间隔，在锁外确认文件未被修改
+    struct stat st;
+    if(stat(path.data(), &st) == 0 && sameFile_(st, (*file)->st)) {
+        (*file)->checkedAt.store(ticks_(now), std::memory_order_relaxed);
+        return true;
+    }
+    // 文件已变化，丢弃旧映射(仍在发送的响应继续持有旧映射)；其他线程可能已换上新的映射，只删除自己看到的那个
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    auto it = shard.entries.find(path);
+    if(it != shard.entries.end() && it->second.file == *file) {
+        erase_(shard, it);
+    }
+    file->reset();
+    return false;
+}
+
+int FileCache::lookup(const std::string &path, FilePtr *file, struct stat *st) {
+    if(hit_(shard_(path), path, file)) {
+        *st = (*file)->st;
+        return 0;
+    }
+    if(stat(path.data(), st) < 0) {
+        return errno;
+    }
+    return check_(*st);
+}
+
+bool FileCache::isHot(const std::string &path, FilePtr *file) {
+    Shard &shard = shard_(path);
+    Clock::time_point now = Clock::now();
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    auto it = shard.entries.find(path);
+    if(it == shard.entries.end() || !it->second.file->addr || !fresh_(*it->second.file, now)) {
+        return false;
+    }
+    if(file) {
+        // 调用方将直接使用该映射，不再经过acquire/lookup，在此更新LRU
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lru);
+        *file = it->second.file;
+    }
+    return true;
+}
+
+int FileCache::acquire(const std::string &path, FilePtr *file) {
+    Shard &shard = shard_(path);
+    if(hit_(shard, path, file)) {
+        return 0;
+    }
+
+    // 未命中：在锁外加载，避免阻塞其他文件的命中
+    Clock::time_point now = Clock::now();
+    int err = load_(path, file);
+    if(err != 0) {
+        return err;
+    }
+    (*file)->checkedAt.store(ticks_(now), std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    if((*file)->addr && (*file)->size() > capacity_.load(std::memory_order_relaxed) / SHARDS / 4) {
+        // 映射过大的文件不进入缓存，避免挤占热点小文件
+        return 0;
+    }
+    auto it = shard.entries.find(path);
+    if(it != shard.entries.end()) {
+        // 其他线程已加载同一文件
+        *file = it->second.file;
+        return 0;
+    }
+    shard.lru.push_front(path);
+    shard.entries[path] = {*file, shard.lru.begin()};
+    shard.bytes += mappedBytes_(**file);
+    if((*file)->fd >= 0) {
+        shard.fds++;
+    }
+    evict_(shard);
+    return 0;
+}
+
+// 只有映射的文件计入上限，sendfile发送的大文件只占用一个fd
+size_t FileCache::mappedBytes_(const MappedFile &file) {
+    return file.addr ? file.size() : 0;
+}
+
+void FileCache::erase_(Shard &shard, EntryMap::iterator it) {
+    shard.bytes -= mappedBytes_(*it->second.file);
+    if(it->second.file->fd >= 0) {
+        shard.fds--;
+    }
+    shard.lru.erase(it->second.lru);
+    shard.entries.erase(it);
+}
+
+void FileCache::evict_(Shard &shard) {
+    // 上限平均分给各分片，fd数向上取整
+    size_t capacity = capacity_.load(std::memory_order_relaxed) / SHARDS;
+    size_t maxFds = (maxFds_.load(std::memory_order_relaxed) + SHARDS - 1) / SHARDS;
+    while(shard.bytes > capacity && !shard.lru.empty()) {
+        erase_(shard, shard.entries.find(shard.lru.back()));
+    }
+    // fd过多：从LRU表尾向前淘汰大文件，映射的小文件不受影响
+    auto pos = shard.lru.end();  // 已检查部分的开头，始终不是被删除的节点
+    while(shard.fds > maxFds && pos != shard.lru.begin()) {
+        auto prev = std::prev(pos);
+        auto it = shard.entries.find(*prev);
+        if(it->second.file->fd >= 0) {
+            erase_(shard, it);
+        } else {
+            pos = prev;
+        }
+    }
+}
+
+void FileCache::setCapacity(size_t bytes) {
+    capacity_.store(bytes, std::memory_order_relaxed);
+    for(Shard &shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        evict_(shard);
+    }
+}
+
+void FileCache::setMaxFds(size_t fds) {
+    maxFds_.store(fds, std::memory_order_relaxed);
+    for(Shard &shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        evict_(shard);
+    }
+}
+
+void FileCache::clear() {
+    for(Shard &shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        shard.entries.clear();
+        shard.lru.clear();
+        shard.bytes = 0;
+        shard.fds = 0;
+    }
+}
\ No newline at end of file
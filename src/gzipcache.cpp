@@ -0,0 +1,200 @@
+#include "../include/gzipcache.hpp"
+
+const size_t GzipCache::DEFAULT_CAPACITY;
+const size_t GzipCache::MAX_SOURCE;
+const size_t GzipCache::ENTRY_COST;
+const int GzipCache::SHARDS;
+
+GzipCache &GzipCache::instance() {
+    static GzipCache cache;
+    return cache;
+}
+
+GzipCache::GzipCache() : isStop_(false), capacity_(DEFAULT_CAPACITY) {
+    worker_ = std::thread(&GzipCache::work_, this);
+}
+
+GzipCache::~GzipCache() {
+    {
+        std::lock_guard<std::mutex> lock(jobMtx_);
+        isStop_ = true;
+    }
+    cond_.notify_all();
+    worker_.join();
+}
+
+bool GzipCache::sameSource_(const struct stat &a, const struct stat &b) {
+    return a.st_ino == b.st_ino && a.st_dev == b.st_dev && a.st_size == b.st_size
+        && a.st_mtim.tv_sec == b.st_mtim.tv_sec && a.st_mtim.tv_nsec == b.st_mtim.tv_nsec;
+}
+
+bool GzipCache::find(const std::string &path, const struct stat &st, FilePtr *gz) {
+    Shard &shard = shard_(path);
+    std::string gzPath;
+    {
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        auto it = shard.entries.find(path);
+        if(it != shard.entries.end() && !sameSource_(it->second.src, st)) {
+            // 源文件已变化
+            erase_(shard, it);
+            it = shard.entries.end();
+        }
+        if(it != shard.entries.end()) {
+            Entry &entry = it->second;
+            shard.lru.splice(shard.lru.begin(), shard.lru, entry.lru);
+            if(entry.state == Compressed) {
+                *gz = entry.gz;
+                return true;
+            }
+            if(entry.state != Sidecar) {
+                return false;
+            }
+            // 预压缩文件的映射及其更新检查交给FileCache；已映射且无需检查时直接取得
+            if(FileCache::instance().isHot(entry.gzPath, gz)) {
+                return true;
+            }
+            gzPath = entry.gzPath;
+        }
+    }
+    if(!gzPath.empty()) {
+        // 需要重新检查或加载预压缩文件，在锁外进行
+        return FileCache::instance().acquire(gzPath, gz) == 0;
+    }
+
+    // 首次请求：在锁外检查是否有不早于源文件的.gz预压缩文件，没有则提交后台压缩
+    gzPath = path + ".gz";
+    struct stat gzStat;
+    bool sidecar = stat(gzPath.data(), &gzStat) == 0 && S_ISREG(gzStat.st_mode)
+        && gzStat.st_mtime >= st.st_mtime;
+    State state = sidecar ? Sidecar : (static_cast<size_t>(st.st_size) > MAX_SOURCE ? Skipped : Pending);
+    {
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        if(shard.entries.count(path) == 1) {
+            // 其他线程已创建缓存项，本次发送未压缩的文件
+            return false;
+        }
+        shard.lru.push_front(path);
+        Entry &entry = shard.entries[path];
+        entry = {state, st, nullptr, sidecar ? gzPath : std::string(), shard.lru.begin()};
+        shard.bytes += cost_(path, entry);
+        evict_(shard);
+    }
+    if(state == Pending) {
+        {
+            std::lock_guard<std::mutex> lock(jobMtx_);
+            jobs_.emplace(path, st);
+        }
+        cond_.notify_one();
+        return false;
+    }
+    return state == Sidecar && FileCache::instance().acquire(gzPath, gz) == 0;
+}
+
+void GzipCache::work_() {
+    while(true) {
+        std::pair<std::string, struct stat> job;
+        {
+            std::unique_lock<std::mutex> lock(jobMtx_);
+            cond_.wait(lock, [this] { return isStop_ || !jobs_.empty(); });
+            if(isStop_) {
+                return;
+            }
+            job = std::move(jobs_.front());
+            jobs_.pop();
+        }
+
+        // 在锁外读取并压缩文件
+        FilePtr gz = compress_(job.first, job.second);
+
+        Shard &shard = shard_(job.first);
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        auto it = shard.entries.find(job.first);
+        if(it == shard.entries.end() || it->second.state != Pending || !sameSource_(it->second.src, job.second)) {
+            // 压缩期间缓存项被淘汰或源文件已变化
+            continue;
+        }
+        if(gz) {
+            it->second.state = Compressed;
+            it->second.gz = gz;
+            shard.bytes += gz->size();
+            evict_(shard);
+        } else {
+            it->second.state = Skipped;
+        }
+    }
+}
+
+FilePtr GzipCache::compress_(const std::string &path, const struct stat &st) {
+    int fd = open(path.data(), O_RDONLY);
+    if(fd < 0) {
+        return nullptr;
+    }
+    std::string src(st.st_size, '\0');
+    size_t n = 0;
+    while(n < src.size()) {
+        ssize_t len = read(fd, &src[n], src.size() - n);
+        if(len <= 0) {
+            break;
+        }
+        n += len;
+    }
+    close(fd);
+    if(n != src.size()) {
+        return nullptr;
+    }
+
+    // windowBits = 15 + 16：输出带gzip头部和尾部的格式
+    z_stream zs = {0};
+    if(deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return nullptr;
+    }
+    std::string out(deflateBound(&zs, src.size()), '\0');
+    zs.next_in = reinterpret_cast<Bytef*>(&src[0]);
+    zs.avail_in = src.size();
+    zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    zs.avail_out = out.size();
+    int ret = deflate(&zs, Z_FINISH);
+    size_t outLen = zs.total_out;
+    deflateEnd(&zs);
+    if(ret != Z_STREAM_END || outLen == 0 || outLen >= src.size()) {
+        // 压缩后不更小，不值得压缩
+        return nullptr;
+    }
+
+    // 压缩内容放在只读的匿名映射中，与映射的文件共用发送路径
+    void *addr = mmap(NULL, outLen, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(addr == MAP_FAILED) {
+        return nullptr;
+    }
+    memcpy(addr, out.data(), outLen);
+    mprotect(addr, outLen, PROT_READ);
+    struct stat gzStat = st;
+    gzStat.st_size = outLen;
+    return FilePtr(new MappedFile(path + ".gz", gzStat, static_cast<char*>(addr), -1));
+}
+
+// 键在表和LRU链中各存一份
+size_t GzipCache::cost_(const std::string &path, const Entry &entry) {
+    return ENTRY_COST + path.size() * 2 + entry.gzPath.size() + (entry.gz ? entry.gz->size() : 0);
+}
+
+void GzipCache::erase_(Shard &shard, EntryMap::iterator it) {
+    shard.bytes -= cost_(it->first, it->second);
+    shard.lru.erase(it->second.lru);
+    shard.entries.erase(it);
+}
+
+void GzipCache::evict_(Shard &shard) {
+    size_t capacity = capacity_.load(std::memory_order_relaxed) / SHARDS;
+    while(shard.bytes > capacity && !shard.lru.empty()) {
+        erase_(shard, shard.entries.find(shard.lru.back()));
+    }
+}
+
+void GzipCache::setCapacity(size_t bytes) {
+    capacity_.store(bytes, std::memory_order_relaxed);
+    for(Shard &shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        evict_(shard);
+    }
+}
\ No newline at end of file
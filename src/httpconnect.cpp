@@ -3,38 +3,70 @@
 const char* HttpConn::srcDir;
 std::atomic<int> HttpConn::userNum;
 bool HttpConn::isET;
+RateLimiter *HttpConn::limiter = nullptr;
+const char* HttpConn::metricsPath = "/metrics";
+AccessLog *HttpConn::accessLog = nullptr;
 
 HttpConn::HttpConn() {
     fd_ = -1;
     addr_ = {0};
     isClose_ = true;
+    keepAlive_ = false;
+    segIdx_ = outBytes_ = 0;
+    responseCnt_ = 0;
+    reqStart_ = 0;
+    pending_ = HttpRequest::NeedMore;
 }
 
 HttpConn::~HttpConn() {
     closeConn();
 }
 
-void HttpConn::initConn(int sockfd, const sockaddr_in& addr) {
+void HttpConn::initConn(int sockfd, const sockaddr_in& addr, const RateLimiter::ConnToken &limitToken) {
     assert(sockfd > 0);
     userNum++;
     addr_ = addr;
+    limitToken_ = limitToken;
     fd_ = sockfd;
     writeBuffer_.RetrieveAll();
     readBuffer_.RetrieveAll();
+    out_.clear();
+    segIdx_ = outBytes_ = 0;
+    responseCnt_ = 0;
+    keepAlive_ = false;
+    logs_.clear();
+    reqStart_ = 0;
+    pending_ = HttpRequest::NeedMore;
+    request_.init();
     isClose_ = false;
 }
 
 void HttpConn::closeConn() {
-    response_.unmapFile();  // 取消映射
+    for(auto &response : responses_) {
+        response->unmapFile();  // 取消映射
+    }
     if(isClose_ == false) {
         isClose_ = true;
+        if(!logs_.empty()) {
+            // 未发送完就关闭：记录实际发出的字节数，未发出的部分从本批最后的响应起扣除
+            size_t unsent = outBytes_;
+            for(auto it = logs_.rbegin(); it != logs_.rend() && unsent > 0; ++it) {
+                size_t n = std::min<size_t>(unsent, it->bytes);
+                it->bytes -= n;
+                unsent -= n;
+            }
+            flushLogs_(Metrics::now());
+        }
         userNum--;
+        if(limiter) {
+            limiter->releaseConn(addr_.sin_addr.s_addr, limitToken_);
+        }
         close(fd_);
     }
 }
 
 int HttpConn::writeBytes() {
-    return iov_[0].iov_len + iov_[1].iov_len;
+    return outBytes_;
 }
 
 ssize_t HttpConn::readBuffer(int *saveError) {
@@ -52,61 +84,245 @@ ssize_t HttpConn::readBuffer(int *saveError) {
 ssize_t HttpConn::writeBuffer(int *saveError) {
     ssize_t len = -1;
     do {
-        // 分散写数据
-        len = writev(fd_, iov_, iovCnt_);
+        // 跳过已发送完的分段
+        while(segIdx_ < out_.size() && out_[segIdx_].len == 0) {
+            segIdx_++;
+        }
+        if(segIdx_ == out_.size()) {
+            // 数据传输结束
+            break;
+        }
+        const BodySegment &first = out_[segIdx_];
+        uint64_t start = Metrics::now();
+        if(first.data == nullptr && first.fd >= 0) {
+            // 文件区间：在内核中直接从页缓存拷贝到socket
+            off_t offset = first.offset;
+            len = sendfile(fd_, first.fd, &offset, first.len);
+        } else {
+            // 分散写：连续的内存分段(writeBuffer_中的响应头、映射的文件等)，可跨越多个响应
+            struct iovec iov[MAX_IOV];
+            int iovCnt = 0;
+            size_t buffered = 0;    // 下一个缓冲分段在writeBuffer_可读数据中的偏移
+            size_t i = segIdx_;
+            for(; i < out_.size() && iovCnt < MAX_IOV; i++) {
+                const BodySegment &seg = out_[i];
+                if(seg.data) {
+                    iov[iovCnt].iov_base = const_cast<char *>(seg.data);
+                    iov[iovCnt++].iov_len = seg.len;
+                } else if(seg.fd < 0) {
+                    // 缓冲分段可能跨越writeBuffer_的多个块，每块一个iovec
+                    size_t exported;
+                    iovCnt += writeBuffer_.PeekIov(buffered, seg.len, iov + iovCnt, MAX_IOV - iovCnt, &exported);
+                    buffered += seg.len;
+                    if(exported < seg.len) {
+                        break;
+                    }
+                } else {
+                    break;
+                }
+            }
+            // MSG_MORE：后面还有待发送的数据时，暂不发出不满的报文段，让两者合并成满包
+            struct msghdr msg = {0};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = iovCnt;
+            len = sendmsg(fd_, &msg, MSG_NOSIGNAL | (i < out_.size() ? MSG_MORE : 0));
+        }
+        uint64_t end = Metrics::now();
+        Metrics::record(Metrics::WRITE, end - start);
         if(len <= 0) {
             *saveError = errno;
             break;
         }
-        if(iov_[0].iov_len + iov_[1].iov_len == 0) {
-            // 缓存为空，数据传输结束
-            break;
-        } else if(static_cast<size_t>(len) > iov_[0].iov_len) {
-            // 写到第二个vector I/O
-            // 更新响应头传输起点、长度和缓冲区
-            iov_[1].iov_base = (uint8_t*)iov_[1].iov_base + (len - iov_[0].iov_len);
-            iov_[1].iov_len -= (len - iov_[0].iov_len);
-            if(iov_[0].iov_len) {
-                // 状态行+响应头已传输完成，不再需要
-                writeBuffer_.RetrieveAll();
-                iov_[0].iov_len = 0;
-            }
-        } else {
-            // 还没写到第二个vector I/O
-            // 更新响应头传输起点、长度和缓冲区
-            iov_[0].iov_base = (uint8_t*)iov_[0].iov_base + len;
-            iov_[0].iov_len -= len;
-            writeBuffer_.Retrieve(len);
+        Metrics::addBytesSent(len);
+        consume_(len);
+        if(outBytes_ == 0 && !logs_.empty()) {
+            // 本批响应全部发出
+            flushLogs_(end);
         }
     } while(isET || writeBytes() > 10240);  // 一次最多传输10MB数据
     return len;
 }
 
-bool HttpConn::handleConn() {
-    request_.init();  // 初始化请求对象
-    if(readBuffer_.readableBytes() <= 0) {
-        //没有请求数据
+void HttpConn::consume_(size_t len) {
+    outBytes_ -= len;
+    for(size_t i = segIdx_; len > 0 && i < out_.size(); i++) {
+        BodySegment &seg = out_[i];
+        size_t n = std::min(len, seg.len);
+        if(seg.data) {
+            seg.data += n;
+        } else if(seg.fd >= 0) {
+            seg.offset += n;
+        } else {
+            writeBuffer_.Retrieve(n);
+        }
+        seg.len -= n;
+        len -= n;
+    }
+}
+
+size_t HttpConn::queueResponse_(const HttpResponse &response, size_t headLen) {
+    size_t before = outBytes_;
+    if(headLen > 0) {
+        // 常规生成的响应头，位于writeBuffer_中
+        out_.push_back({nullptr, -1, 0, headLen});
+        outBytes_ += headLen;
+    }
+    for(const BodySegment &seg : response.body()) {
+        if(seg.len > 0) {
+            out_.push_back(seg);
+            outBytes_ += seg.len;
+        }
+    }
+    return outBytes_ - before;
+}
+
+void HttpConn::logRequest_(int status, size_t bytes) {
+    if(accessLog) {
+        logs_.emplace_back();
+        logs_.back().set(addr_.sin_addr.s_addr, request_.method(), request_.path(), status, bytes, 
+            reqStart_ ? reqStart_ : Metrics::now());
+    }
+    reqStart_ = 0;
+}
+
+void HttpConn::flushLogs_(uint64_t end) {
+    for(AccessLog::Record &record : logs_) {
+        record.duration = end - record.start;
+        accessLog->append(record);
+    }
+    logs_.clear();
+}
+
+bool HttpConn::isFast_() {
+    if(isMetrics_()) {
+        return true;
+    }
+    if(request_.method() != "GET") {
         return false;
-    } else if(request_.parse(readBuffer_)) {
-        // 解析请求数据，初始化响应对象
-        response_.init(srcDir, request_.path(), request_.isKeepAlive(), 200);
-    } else {
-        // 解析请求数据失败
-        std::cout << "400!" << std::endl;
-        response_.init(srcDir, request_.path(), false, 400);
     }
+    filePath_.assign(srcDir).append(request_.path());
+    return FileCache::instance().isHot(filePath_, &hotFile_);
+}
+
+bool HttpConn::isMetrics_() const {
+    return metricsPath && request_.path() == metricsPath && request_.method() == "GET";
+}
 
-    // 生成响应数据
-    response_.makeResponse(writeBuffer_);
-    // 响应行+头(第一个vector I/O)：指向writeBuffer_
-    iov_[0].iov_base = const_cast<char *>(writeBuffer_.curReadPtr());
-    iov_[0].iov_len = writeBuffer_.readableBytes();
-    iovCnt_ = 1;
-    // 响应体(第二个vector I/O)：指向内存映射的文件
-    if(response_.file() && response_.fileLength() > 0) {
-        iov_[1].iov_base = response_.file();
-        iov_[1].iov_len = response_.fileLength();
-        iovCnt_ = 2;
+void HttpConn::serveMetrics_() {
+    std::string body = Metrics::instance().render();
+    size_t before = writeBuffer_.readableBytes();
+    writeBuffer_.Append("HTTP/1.1 200 OK\r\n");
+    writeBuffer_.Append("Content-Type: text/plain; version=0.0.4\r\n");
+    writeBuffer_.Append("Cache-Control: no-store\r\n");
+    writeBuffer_.Append(keepAlive_ ? "Connection: keep-alive\r\n" : "Connection: close\r\n");
+    writeBuffer_.Append("Content-Length: " + std::to_string(body.size()) + "\r\n\r\n");
+    writeBuffer_.Append(body);
+    size_t len = writeBuffer_.readableBytes() - before;
+    out_.push_back({nullptr, -1, 0, len});
+    outBytes_ += len;
+    Metrics::addStatus(200);
+    logRequest_(200, len);
+}
+
+bool HttpConn::handleConn(bool fastOnly) {
+    if(writeBytes() > 0) {
+        // 上一批响应尚未发送完，发完后再处理后续请求，保证响应顺序
+        return true;
+    }
+    // 开始新的一批：依次解析缓冲区中所有完整的请求，响应按请求顺序加入发送队列
+    out_.clear();
+    segIdx_ = 0;
+    responseCnt_ = 0;
+    for(int handled = 0; handled < MAX_PIPELINE; handled++) {
+        HttpRequest::ParseResult result = pending_;
+        if(result == HttpRequest::NeedMore) {
+            if(request_.isFinish()) {
+                // 上一个请求已处理完，初始化请求对象
+                request_.init();
+            }
+            if(readBuffer_.readableBytes() <= 0) {
+                //没有请求数据
+                break;
+            }
+            uint64_t start = Metrics::now();
+            if(reqStart_ == 0) {
+                reqStart_ = start;
+            }
+            result = request_.parse(readBuffer_);
+            Metrics::recordSince(Metrics::PARSE, start);
+            if(result == HttpRequest::NeedMore) {
+                // 请求报文不完整，保留解析状态，等待后续数据
+                break;
+            }
+        }
+        if(fastOnly && (result != HttpRequest::Complete || !isFast_())) {
+            // 较慢的请求留给工作线程处理，之前的响应先发送
+            pending_ = result;
+            break;
+        }
+        pending_ = HttpRequest::NeedMore;
+        FilePtr file = std::move(hotFile_); // 只属于当前请求，不留给后续请求
+        if(limiter && result == HttpRequest::Complete && !limiter->allowRequest(addr_.sin_addr.s_addr)) {
+            // 超出该IP的请求速率：直接发送预先生成的429(不拷贝)，之后关闭连接
+            const std::string &reject = limiter->response();
+            out_.push_back({reject.data(), -1, 0, reject.size()});
+            outBytes_ += reject.size();
+            keepAlive_ = false;
+            Metrics::addStatus(429);
+            logRequest_(429, reject.size());
+            break;
+        }
+        if(result == HttpRequest::Complete && isMetrics_()) {
+            // 运行指标：不经过HttpResponse，不占用响应对象
+            keepAlive_ = request_.isKeepAlive();
+            serveMetrics_();
+            if(!keepAlive_) {
+                break;
+            }
+            continue;
+        }
+        if(responseCnt_ == responses_.size()) {
+            responses_.emplace_back(new HttpResponse());
+        }
+        HttpResponse &response = *responses_[responseCnt_++];
+        if(result == HttpRequest::Complete) {
+            // 解析请求数据，初始化响应对象
+            response.init(srcDir, request_.path(), request_.isKeepAlive(), 200, &request_, std::move(file));
+        } else {
+            // 解析请求数据失败
+            response.init(srcDir, request_.path(), false, 400);
+        }
+        keepAlive_ = request_.isKeepAlive();
+
+        // 生成响应数据，响应头追加在writeBuffer_中已排队的数据之后
+        size_t before = writeBuffer_.readableBytes();
+        uint64_t start = Metrics::now();
+        response.makeResponse(writeBuffer_);
+        Metrics::recordSince(Metrics::RESPONSE, start);
+        Metrics::addStatus(response.code());
+        logRequest_(response.code(), queueResponse_(response, writeBuffer_.readableBytes() - before));
+        if(!keepAlive_) {
+            // 本响应后关闭连接，之后的请求不再处理
+            break;
+        }
+    }
+    if(out_.empty() && pending_ == HttpRequest::NeedMore) {
+        // 没有待处理的请求，连接进入空闲
+        releaseIdle_();
+    }
+    return !out_.empty();
+}
+
+void HttpConn::releaseIdle_() {
+    // 此时发送队列已空
+    writeBuffer_.Release();
+    std::vector<std::unique_ptr<HttpResponse>>().swap(responses_);
+    std::vector<BodySegment>().swap(out_);
+    std::vector<AccessLog::Record>().swap(logs_);
+    if(readBuffer_.readableBytes() == 0) {
+        readBuffer_.Release();
+        if(request_.isIdle()) {
+            request_.release();
+        }
     }
-    return true;
 }
\ No newline at end of file
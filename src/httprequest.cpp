@@ -6,61 +6,104 @@ const std::unordered_set<std::string> HttpRequest::DEFAULT_HTML {
 
 void HttpRequest::init() {
     parse_state_ = RequestLine;
-    path_ = method_ = version_ = body_ = "";
-    header_.clear();
+    scanned_ = 0;
+    contentLength_ = 0;
+    isKeepAlive_ = false;
+    // clear()保留已分配的容量，同一连接上的后续请求无需重新分配内存
+    method_.clear();
+    path_.clear();
+    version_.clear();
+    body_.clear();
+    headerCnt_ = 0;
     post_.clear();
 }
 
-// Connection:keep-alive键值对<key>:<value>
+void HttpRequest::release() {
+    init();
+    std::string().swap(method_);
+    std::string().swap(path_);
+    std::string().swap(version_);
+    std::string().swap(body_);
+    std::vector<std::pair<std::string, std::string>>().swap(header_);
+    std::unordered_map<std::string, std::string>().swap(post_);
+}
+
 bool HttpRequest::isKeepAlive() const {
-    if(header_.count("Connection") == 1) {
-        return header_.find("Connection")->second == "keep-alive" && version_ == "1.1";
-    }
-    return false;
+    return isKeepAlive_;
 }
 
-bool HttpRequest::parse(Buffer &buffer) {
-    const char *CRLF = "\r\n";  // 回车换行符
-    if(buffer.readableBytes() <= 0) {
-        return false;
+HttpRequest::ParseResult HttpRequest::parse(Buffer &buffer) {
+    ParseResult result = ParseLines_(buffer);
+    if(result == Malformed) {
+        // 格式错误的请求无法继续解析，结束请求并关闭长连接
+        isKeepAlive_ = false;
+        parse_state_ = Finish;
     }
-    // buffer中有可读数据&&解析状态未到Finish，就一直解析
-    while(buffer.readableBytes() && parse_state_ != Finish) {
-        // 获取每一行，以\r\n为结束标志，lineEnd指向\r
-        const char* lineEnd = std::search(buffer.curReadPtr(), buffer.curWritePtrConst(), CRLF, CRLF + 2);
-        std::string line(buffer.curReadPtr(), lineEnd);
+    return result;
+}
+
+HttpRequest::ParseResult HttpRequest::ParseLines_(Buffer &buffer) {
+    // 解析状态未到Finish，就一直解析
+    while(parse_state_ != Finish) {
+        if(parse_state_ == Body) {
+            // 请求体按Content-Length读取，不以\r\n分行；可能跨越多个块，直接从各块拷贝出来
+            if(buffer.readableBytes() < contentLength_) {
+                return NeedMore;
+            }
+            if(!ParseBody(buffer.RetrieveToString(contentLength_))) {
+                return Malformed;
+            }
+            break;
+        }
+        const char *begin = buffer.curReadPtr();
+        const char *end = begin + buffer.contiguousBytes();
+
+        // 获取每一行，以\r\n为结束标志，lineEnd指向\r；从上次扫描结束处继续查找(回退1字节，防止\r\n被拆在两次读取之间)
+        size_t from = scanned_ > 0 ? scanned_ - 1 : 0;
+        const char *lineEnd = SimdScan::findCRLF(begin + from, end);
+        if(lineEnd == end) {
+            size_t limit = std::min(buffer.readableBytes(), MAX_LINE + 2);
+            if(buffer.contiguousBytes() < limit) {
+                // 行跨越了块的边界：把行首开始的数据合并到首块中再查找(罕见)
+                scanned_ = end - begin;
+                buffer.Pullup(limit);
+                continue;
+            }
+            // 当前行不完整
+            scanned_ = end - begin;
+            if(scanned_ > MAX_LINE) {
+                return Malformed;
+            }
+            return NeedMore;
+        }
+        scanned_ = 0;
+        if(static_cast<size_t>(lineEnd - begin) > MAX_LINE) {
+            return Malformed;
+        }
+
+        bool ok = true;
         switch (parse_state_)
         {
         case RequestLine:
-            // 解析请求行
-            if(!ParseRequestLine(line)) {
-                return false;
+            // 解析请求行，忽略请求行之前的空行
+            if(lineEnd != begin) {
+                ok = ParseRequestLine(begin, lineEnd);
             }
-            ParsePath();
             break;
         case Header:
-            // 解析请求头部
-            ParseHeader(line);
-            if(buffer.readableBytes() <= 2) {
-                // 缓冲区无可读数据
-                parse_state_ = Finish;
-            }
-            break;
-        case Body:
-            // 解析请求体
-            ParseBody(line);
+            // 解析请求头部，空行表示头部结束
+            ok = (lineEnd == begin) ? ParseHeaderEnd() : ParseHeader(begin, lineEnd);
             break;
         default:
             break;
         }
-        if(lineEnd == buffer.curWritePtr()) {
-            // \r即为buffer中最后写入的数据
-            break;
+        if(!ok) {
+            return Malformed;
         }
         // 读取到\n的下一位
         buffer.RetrieveUntill(lineEnd + 2);
     }
-    return true;
+    return Complete;
 }
 
 std::string HttpRequest::path() const {
@@ -95,6 +138,17 @@ std::string HttpRequest::GetPost(const char* key) const {
     return "";
 }
 
+const std::string& HttpRequest::GetHeader(const char* key) const {
+    static const std::string empty;
+    assert(key != nullptr);
+    for(size_t i = 0; i < headerCnt_; i++) {
+        if(strcasecmp(header_[i].first.c_str(), key) == 0) {
+            return header_[i].second;
+        }
+    }
+    return empty;
+}
+
 void HttpRequest::ParsePath() {
     if(path_ == "/") {
         // 若访问根目录，默认访问index.html
@@ -112,42 +166,101 @@ void HttpRequest::ParsePath() {
     }
 }
 
-// 解析请求行
-bool HttpRequest::ParseRequestLine(const std::string& line) {
-    std::regex patten("^([^ ]*) ([^ ]*) HTTP/([^ ]*)$");
-    std::smatch subMatch;
-    if(std::regex_match(line, subMatch, patten)) {
-        method_ = subMatch[1];
-        path_ = subMatch[2];
-        version_ = subMatch[3];
-        parse_state_ = Header;
-        return true;
+// 解析请求行：<method> SP <path> SP HTTP/<version>
+bool HttpRequest::ParseRequestLine(const char *begin, const char *end) {
+    // 方法和路径中不允许出现控制字符，因此第一个<=0x20的字节必须是分隔的空格
+    const char *sp1 = SimdScan::findCtl(begin, end);
+    if(sp1 == end || sp1 == begin || *sp1 != ' ') {
+        return false;
     }
-    return false;
+    const char *sp2 = SimdScan::findCtl(sp1 + 1, end);
+    if(sp2 == end || sp2 == sp1 + 1 || *sp2 != ' ') {
+        return false;
+    }
+    // 协议版本必须形如HTTP/x.y
+    const char *ver = sp2 + 1;
+    if(end - ver != 8 || memcmp(ver, "HTTP/", 5) != 0
+        || !isdigit(ver[5]) || ver[6] != '.' || !isdigit(ver[7])) {
+        return false;
+    }
+    method_.assign(begin, sp1);
+    path_.assign(sp1 + 1, sp2);
+    version_.assign(ver + 5, end);
+    ParsePath();
+    parse_state_ = Header;
+    return true;
 }
 
-// 解析请求头部
-void HttpRequest::ParseHeader(const std::string& line) {
-    std::regex patten("^([^:]*): ?(.*)$");
-    std::smatch subMatch;
-    if(regex_match(line, subMatch, patten)) {
-        header_[subMatch[1]] = subMatch[2];
+// 解析请求头部：<key>:OWS<value>OWS
+bool HttpRequest::ParseHeader(const char *begin, const char *end) {
+    const char *colon = SimdScan::findChar(begin, end, ':');
+    if(colon == end || colon == begin) {
+        return false;
+    }
+    if(SimdScan::findCtl(begin, colon) != colon) {
+        // 字段名中不允许出现空白
+        return false;
+    }
+    const char *vbegin = colon + 1;
+    while(vbegin < end && (*vbegin == ' ' || *vbegin == '\t')) {
+        vbegin++;
+    }
+    const char *vend = end;
+    while(vend > vbegin && (vend[-1] == ' ' || vend[-1] == '\t')) {
+        vend--;
+    }
+    if(headerCnt_ == MAX_HEADERS) {
+        return false;
+    }
+    if(headerCnt_ == header_.size()) {
+        header_.emplace_back();
+    }
+    header_[headerCnt_].first.assign(begin, colon);
+    header_[headerCnt_].second.assign(vbegin, vend);
+    headerCnt_++;
+    return true;
+}
+
+// 头部结束：确定长连接和请求体长度
+bool HttpRequest::ParseHeaderEnd() {
+    const std::string& conn = GetHeader("Connection");
+    if(version_ == "1.1") {
+        // HTTP/1.1默认长连接
+        isKeepAlive_ = strcasecmp(conn.c_str(), "close") != 0;
     } else {
-        // 解析到空行，parse_state_转为解析请求体
-        parse_state_ = Body;
+        isKeepAlive_ = strcasecmp(conn.c_str(), "keep-alive") == 0;
+    }
+
+    if(!GetHeader("Transfer-Encoding").empty()) {
+        // 不支持分块传输的请求体
+        return false;
+    }
+    const std::string& len = GetHeader("Content-Length");
+    contentLength_ = 0;
+    for(char ch : len) {
+        if(!isdigit(ch)) {
+            return false;
+        }
+        contentLength_ = contentLength_ * 10 + (ch - '0');
+        if(contentLength_ > MAX_BODY) {
+            return false;
+        }
     }
+    parse_state_ = contentLength_ > 0 ? Body : Finish;
+    return true;
 }
 
 // 解析请求体
-void HttpRequest::ParseBody(const std::string& line) {
-    body_ = line;
+bool HttpRequest::ParseBody(std::string &&body) {
+    body_ = std::move(body);
     ParsePost();
     parse_state_ = Finish;
+    return true;
 }
 
 // 解析POST报文
 void HttpRequest::ParsePost() {
-    if(method_ == "POST" && header_["Content-Type"] == "application/x-www-form-urlencoded") {
+    if(method_ == "POST" && GetHeader("Content-Type") == "application/x-www-form-urlencoded") {
         // 解析表单信息
         int n = body_.size();
         if( n == 0) {
@@ -193,4 +306,6 @@ void HttpRequest::ParsePost() {
 int HttpRequest::ConvertHex(char ch) {
     if(ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
     if(ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+    if(ch >= '0' && ch <= '9') return ch - '0';
+    return 0;
 }
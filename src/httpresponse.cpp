@@ -19,15 +19,26 @@ const std::unordered_map<std::string, std::string> HttpResponse::SUFFIX_TYPE {
     {".gz",    "application/x-gzip"},
     {".tar",   "application/x-tar"},
     {".css",   "text/css"},
-    {".js",    "text/javascript"}
+    {".js",    "text/javascript"},
+    {".svg",   "image/svg+xml"},
+    {".ico",   "image/x-icon"},
+    {".mp4",   "video/mp4"},
+    {".woff",  "font/woff"},
+    {".woff2", "font/woff2"},
+    {".ttf",   "font/ttf"},
+    {".otf",   "font/otf"},
+    {".eot",   "application/vnd.ms-fontobject"},
 };
 
 // 状态码对应的服务器应答的状态
 const std::unordered_map<int, std::string> HttpResponse::CODE_STATE {
     {200, "OK"},
+    {206, "Partial Content"},
+    {304, "Not Modified"},
     {400, "Bad Request"},
     {403, "Forbidden"},
     {404, "Not Found"},
+    {416, "Range Not Satisfiable"},
 };
 
 // 状态码对应的资源路径
@@ -37,58 +48,201 @@ const std::unordered_map<int, std::string> HttpResponse::CODE_PATH {
     {404, "/404.html"},
 };
 
+// 文件类型对应的缓存策略：页面每次都向服务器验证，静态资源允许客户端缓存一天，未列出的类型为no-cache
+const std::unordered_map<std::string, std::string> HttpResponse::CACHE_CONTROL {
+    {"text/html",       "no-cache"},
+    {"text/css",        "public, max-age=86400"},
+    {"text/javascript", "public, max-age=86400"},
+    {"image/png",       "public, max-age=86400"},
+    {"image/gif",       "public, max-age=86400"},
+    {"image/jpg",       "public, max-age=86400"},
+    {"image/svg+xml",   "public, max-age=86400"},
+    {"image/x-icon",    "public, max-age=86400"},
+    {"font/woff",       "public, max-age=86400"},
+    {"font/woff2",      "public, max-age=86400"},
+    {"font/ttf",        "public, max-age=86400"},
+    {"font/otf",        "public, max-age=86400"},
+    {"application/vnd.ms-fontobject", "public, max-age=86400"},
+};
+
+// 文本类资源压缩率高；图片、woff/woff2字体本身已压缩，不在此列
+const std::unordered_set<std::string> HttpResponse::COMPRESSIBLE_TYPE {
+    "text/html", "text/xml", "text/plain", "text/css", "text/javascript",
+    "application/xhtml+xml", "application/rtf", "image/svg+xml", "image/x-icon",
+    "font/ttf", "font/otf", "application/vnd.ms-fontobject",
+};
+
+const char *HttpResponse::BOUNDARY = "HCsTinyWebServerByteranges";
+
 HttpResponse::HttpResponse() 
-    : stateCode_(-1), isKeepAlive_(false), path_(""), srcDir_(""), mmapFile_(nullptr), mmapFileStat_({0}) {}
+    : stateCode_(-1), isKeepAlive_(false), path_(""), srcDir_(""), fileStat_({0}), lastModified_(0), 
+    compressible_(false), gzip_(false), request_(nullptr) {}
 
 HttpResponse::~HttpResponse() {
     unmapFile();
 }
 
 void HttpResponse::unmapFile() {
-    if(mmapFile_) {
-        munmap(mmapFile_, mmapFileStat_.st_size);
-        mmapFile_ = nullptr;
-    }
+    // 映射由FileCache共享，最后一个引用释放时才会munmap
+    file_.reset();
 }
 
-void HttpResponse::init(const std::string& srcDir, std::string& path, bool isKeepAlive, int stateCode) {
+void HttpResponse::init(const std::string& srcDir, std::string& path, bool isKeepAlive, int stateCode,
+        const HttpRequest *request, FilePtr file) {
     assert(srcDir != "");
 
-    if(mmapFile_) {
-        unmapFile();
-    }
+    file_ = std::move(file);
 
     stateCode_ = stateCode;
     isKeepAlive_ = isKeepAlive;
     path_ = path;
     srcDir_ = srcDir;
-    mmapFile_ = nullptr;
-    mmapFileStat_ = {0};
+    request_ = request;
+    fileStat_ = {0};
+    lastModified_ = 0;
+    etag_.clear();
+    compressible_ = gzip_ = false;
+    ranges_.clear();
+    body_.clear();
 }
 
 void HttpResponse::makeResponse(Buffer& buffer) {
     // 判断请求的资源文件
-    if(stat((srcDir_ + path_).data(), &mmapFileStat_) < 0 || S_ISDIR(mmapFileStat_.st_mode)) {
-        // srcDir_ + path_文件状态获取失败or文件是目录
-        stateCode_ = 404;
-    } else if(!(mmapFileStat_.st_mode & S_IROTH)) {
-        // 其他人对文件没有读权限
-        stateCode_ = 403;
-    } else if(stateCode_ == -1) {
-        stateCode_ = 200;
+    if(stateCode_ >= 400) {
+        // 请求解析失败，直接返回错误页面
+    } else {
+        // 先只获取文件状态(命中缓存时同时得到映射，热点文件不产生文件系统调用)；调用方已查到映射时直接使用
+        std::string joined;
+        int err = 0;
+        if(file_) {
+            fileStat_ = file_->st;
+        } else {
+            joined = srcDir_ + path_;
+            err = FileCache::instance().lookup(joined, &file_, &fileStat_);
+        }
+        const std::string &file = file_ ? file_->path : joined; // 只在file_被替换(gzip)之前使用
+        if(err == EACCES) {
+            // 其他人对文件没有读权限
+            stateCode_ = 403;
+        } else if(err != 0) {
+            // srcDir_ + path_文件不存在or文件是目录
+            stateCode_ = 404;
+        } else if(stateCode_ == -1 || stateCode_ == 200) {
+            stateCode_ = 200;
+            // 可压缩的类型：客户端接受gzip且已有压缩内容(预压缩文件或后台压缩的结果)时发送gzip内容
+            FilePtr gz;
+            compressible_ = COMPRESSIBLE_TYPE.count(getFileType()) == 1;
+            gzip_ = compressible_ && acceptGzip_() && GzipCache::instance().find(file, fileStat_, &gz);
+            etag_ = makeETag_(fileStat_, gzip_ ? &gz->st : nullptr);
+            lastModified_ = gzip_ ? std::max(fileStat_.st_mtime, gz->st.st_mtime) : fileStat_.st_mtime;
+            if(notModified_()) {
+                // 客户端缓存仍有效，无需打开文件(命中缓存时保留file_以使用其上的预序列化响应头)
+                stateCode_ = 304;
+                if(gzip_) {
+                    // 响应头中的验证器取决于压缩内容，预序列化的响应头放在压缩内容上，预压缩文件更新后随之失效
+                    file_ = gz;
+                }
+            } else if(gzip_) {
+                file_ = gz;
+                parseRange_();
+            } else if(!file_ && FileCache::instance().acquire(file, &file_) != 0) {
+                stateCode_ = 404;
+            } else {
+                if(fileStat_.st_mtim.tv_nsec != file_->st.st_mtim.tv_nsec || fileStat_.st_mtime != file_->st.st_mtime
+                    || fileStat_.st_size != file_->st.st_size) {
+                    // lookup()之后文件被修改过，以实际映射的文件为准
+                    fileStat_ = file_->st;
+                    etag_ = makeETag_(fileStat_, nullptr);
+                    lastModified_ = fileStat_.st_mtime;
+                }
+                parseRange_();
+            }
+        }
     }
 
     errorHTML();
-    addStateLine(buffer);
-    addResponseHeader(buffer);
-    addResponseContent(buffer);
+    if(!makeCachedResponse_()) {
+        addStateLine(buffer);
+        addResponseHeader(buffer);
+        addResponseContent(buffer);
+    }
+    request_ = nullptr;
+}
+
+int HttpResponse::headerSlot_() const {
+    if(!file_ || !ranges_.empty()) {
+        return -1;
+    }
+    int code;
+    switch (stateCode_)
+    {
+    case 200: code = 0; break;
+    case 304: code = 1; break;
+    case 400: code = 2; break;
+    case 403: code = 3; break;
+    case 404: code = 4; break;
+    default: return -1;
+    }
+    return (code * 2 + isKeepAlive_) * 2 + gzip_;
+}
+
+bool HttpResponse::makeCachedResponse_() {
+    int slot = headerSlot_();
+    if(slot < 0) {
+        return false;
+    }
+    std::atomic<const std::string*> &header = file_->headers[slot];
+    const std::string *block = header.load(std::memory_order_acquire);
+    if(block == nullptr) {
+        // 首次使用：按常规流程生成，错误页面连同页面内容一起保存
+        Buffer buffer;
+        addStateLine(buffer);
+        addResponseHeader(buffer);
+        addResponseContent(buffer);
+        if(CODE_PATH.count(stateCode_) == 1) {
+            buffer.Append(file_->addr ? file_->addr : "", file_->size());
+        }
+        const std::string *rendered = new std::string(buffer.RetrieveAllToString());
+        if(header.compare_exchange_strong(block, rendered, std::memory_order_acq_rel)) {
+            block = rendered;
+        } else {
+            // 其他线程已生成
+            delete rendered;
+        }
+    }
+
+    // 分段：状态行+"Date: " | 当前时间 | 其余头部(+错误页面) | 文件内容
+    size_t datePos = block->find('\n') + 1 + 6;
+    size_t dateLen = strlen(currentDate_());
+    assert(block->compare(datePos - 6, 6, "Date: ") == 0);
+    memcpy(date_, currentDate_(), dateLen);
+    body_.clear();
+    body_.push_back({block->data(), -1, 0, datePos});
+    body_.push_back({date_, -1, 0, dateLen});
+    body_.push_back({block->data() + datePos + dateLen, -1, 0, block->size() - datePos - dateLen});
+    if(stateCode_ == 200) {
+        addFileSegment_(0, file_->size());
+    }
+    return true;
+}
+
+const char *HttpResponse::currentDate_() {
+    thread_local time_t last = 0;
+    thread_local char date[32];
+    time_t now = time(nullptr);
+    if(now != last) {
+        std::string str = httpDate_(now);
+        memcpy(date, str.data(), str.size() + 1);
+        last = now;
+    }
+    return date;
 }
 
 void HttpResponse::errorHTML() {
     if(CODE_PATH.count(stateCode_) == 1) {
         // 对应CODE_PATH中的一种错误状态
         path_ = CODE_PATH.find(stateCode_)->second; // 状态码对应的路径
-        stat((srcDir_ + path_).data(), &mmapFileStat_);
+        FileCache::instance().acquire(srcDir_ + path_, &file_);
     }
 }
 
@@ -104,7 +258,9 @@ void HttpResponse::addStateLine(Buffer& buffer) {
 }
 
 void HttpResponse::addResponseHeader(Buffer& buffer) {
-    buffer.Append("Connection: ");
+    buffer.Append("Date: ");
+    buffer.Append(currentDate_());
+    buffer.Append("\r\nConnection: ");
     if(isKeepAlive_) {
         buffer.Append("keep-alive\r\n");
         // 长链接最多接收6次请求就断开，超时时间120s
@@ -112,26 +268,308 @@ void HttpResponse::addResponseHeader(Buffer& buffer) {
     } else {
         buffer.Append("close\r\n");
     }
-    buffer.Append("Content-type: " + getFileType() + "\r\n");
+    if(stateCode_ == 304) {
+        // 304只携带验证器和缓存策略
+        addValidators_(buffer);
+        return;
+    }
+    if(stateCode_ == 206 && ranges_.size() > 1) {
+        buffer.Append(std::string("Content-type: multipart/byteranges; boundary=") + BOUNDARY + "\r\n");
+    } else {
+        buffer.Append("Content-type: " + getFileType() + "\r\n");
+    }
+    if(file_ && (stateCode_ == 200 || stateCode_ == 206)) {
+        // 告知客户端支持按字节区间请求
+        buffer.Append("Accept-Ranges: bytes\r\n");
+        addValidators_(buffer);
+    }
+}
+
+void HttpResponse::addValidators_(Buffer& buffer) {
+    if(gzip_) {
+        buffer.Append("Content-Encoding: gzip\r\n");
+    }
+    if(compressible_) {
+        // 响应内容取决于Accept-Encoding，告知中间缓存按该字段区分
+        buffer.Append("Vary: Accept-Encoding\r\n");
+    }
+    buffer.Append("ETag: " + etag_ + "\r\n");
+    buffer.Append("Last-Modified: " + httpDate_(lastModified_) + "\r\n");
+    auto it = CACHE_CONTROL.find(getFileType());
+    buffer.Append("Cache-Control: " + (it == CACHE_CONTROL.end() ? std::string("no-cache") : it->second) + "\r\n");
+}
+
+static unsigned long long MtimeNs(const struct stat& st) {
+    return static_cast<unsigned long long>(st.st_mtim.tv_sec) * 1000000000ULL + st.st_mtim.tv_nsec;
+}
+
+/*  强ETag："<inode>-<大小>-<修改时间(纳秒)>[-gz<压缩内容大小>-<压缩内容修改时间>]"，文件内容不变时各连接、各进程得到相同的值
+    预压缩文件可能在源文件不变时单独更新，因此gzip内容的ETag还取决于压缩内容本身
+*/
+std::string HttpResponse::makeETag_(const struct stat& st, const struct stat *gz) {
+    char buf[128];
+    int n = snprintf(buf, sizeof(buf), "\"%llx-%llx-%llx", static_cast<unsigned long long>(st.st_ino),
+        static_cast<unsigned long long>(st.st_size), MtimeNs(st));
+    if(gz) {
+        n += snprintf(buf + n, sizeof(buf) - n, "-gz%llx-%llx", static_cast<unsigned long long>(gz->st_size), MtimeNs(*gz));
+    }
+    n += snprintf(buf + n, sizeof(buf) - n, "\"");
+    return std::string(buf, n);
+}
+
+bool HttpResponse::parseHttpDate_(const std::string& date, time_t *t) {
+    struct tm tm = {0};
+    const char *end = strptime(date.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if(end == nullptr || *end != '\0') {
+        return false;
+    }
+    *t = timegm(&tm);
+    return true;
+}
+
+bool HttpResponse::matchETagList_(const std::string& list) const {
+    const char *p = list.data(), *end = list.data() + list.size();
+    while(p < end) {
+        while(p < end && (*p == ' ' || *p == '\t' || *p == ',')) {
+            p++;
+        }
+        const char *tagEnd = std::find(p, end, ',');
+        const char *last = tagEnd;
+        while(last > p && (last[-1] == ' ' || last[-1] == '\t')) {
+            last--;
+        }
+        if(last - p == 1 && *p == '*') {
+            return true;
+        }
+        // 弱比较：忽略W/前缀
+        if(last - p > 2 && p[0] == 'W' && p[1] == '/') {
+            p += 2;
+        }
+        if(static_cast<size_t>(last - p) == etag_.size() && std::equal(p, last, etag_.begin())) {
+            return true;
+        }
+        p = tagEnd;
+    }
+    return false;
+}
+
+// Accept-Encoding: gzip, deflate;q=0.5, *;q=0，q=0表示不接受
+bool HttpResponse::acceptGzip_() const {
+    if(request_ == nullptr) {
+        return false;
+    }
+    const std::string& accept = request_->GetHeader("Accept-Encoding");
+    const char *p = accept.data(), *end = accept.data() + accept.size();
+    while(p < end) {
+        while(p < end && (*p == ' ' || *p == '\t' || *p == ',')) {
+            p++;
+        }
+        const char *itemEnd = std::find(p, end, ',');
+        const char *nameEnd = std::find(p, itemEnd, ';');
+        const char *last = nameEnd;
+        while(last > p && (last[-1] == ' ' || last[-1] == '\t')) {
+            last--;
+        }
+        std::string coding(p, last);
+        if(strcasecmp(coding.c_str(), "gzip") == 0 || strcasecmp(coding.c_str(), "x-gzip") == 0 || coding == "*") {
+            const char *q = std::find(nameEnd, itemEnd, '=');
+            // q值为0(0、0.0、0.00...)时拒绝
+            bool zero = q != itemEnd && strtod(std::string(q + 1, itemEnd).c_str(), nullptr) == 0.0;
+            return !zero;
+        }
+        p = itemEnd;
+    }
+    return false;
+}
+
+// If-None-Match优先于If-Modified-Since
+bool HttpResponse::notModified_() const {
+    if(request_ == nullptr) {
+        return false;
+    }
+    std::string method = request_->method();
+    if(method != "GET" && method != "HEAD") {
+        return false;
+    }
+    const std::string& ifNoneMatch = request_->GetHeader("If-None-Match");
+    if(!ifNoneMatch.empty()) {
+        return matchETagList_(ifNoneMatch);
+    }
+    const std::string& ifModifiedSince = request_->GetHeader("If-Modified-Since");
+    time_t since;
+    if(!ifModifiedSince.empty() && parseHttpDate_(ifModifiedSince, &since)) {
+        return lastModified_ <= since;
+    }
+    return false;
 }
 
 void HttpResponse::addResponseContent(Buffer& buffer) {
-    // 打开srcDir_ + path_指定的文件：只读
-    int srcFd = open((srcDir_ + path_).data(), O_RDONLY);
-    if(srcFd < 0) {
-        errorContent(buffer, "File Not Found, Open Failed!");
+    if(stateCode_ == 304) {
+        // 304没有响应体
+        buffer.Append("\r\n");
+        return;
+    }
+    if(stateCode_ == 416) {
+        // 请求的区间均超出文件范围，不发送文件内容
+        buffer.Append("Content-Range: bytes */" + std::to_string(fileLength()) + "\r\n");
+        buffer.Append("Content-length: 0\r\n\r\n");
+        unmapFile();
+        return;
+    }
+    if(!file_) {
+        errorContent(buffer, "File Not Found!");
+        return;
+    }
+    std::string total = std::to_string(file_->size());
+    if(stateCode_ == 206 && ranges_.size() == 1) {
+        // 单个区间：只发送[first, last]
+        size_t first = ranges_[0].first, last = ranges_[0].second;
+        buffer.Append("Content-Range: bytes " + std::to_string(first) + "-" + std::to_string(last) + "/" + total + "\r\n");
+        buffer.Append("Content-length: " + std::to_string(last - first + 1) + "\r\n\r\n");
+        addFileSegment_(first, last + 1);
+    } else if(stateCode_ == 206) {
+        // 多个区间：multipart/byteranges，每个区间前加分段头部
+        std::string type = getFileType();
+        std::vector<size_t> heads;  // 各分段头部在multipart_中的结束位置
+        multipart_.clear();
+        for(size_t i = 0; i < ranges_.size(); i++) {
+            multipart_ += (i == 0 ? "--" : "\r\n--");
+            multipart_ += BOUNDARY;
+            multipart_ += "\r\nContent-Type: " + type + "\r\nContent-Range: bytes ";
+            multipart_ += std::to_string(ranges_[i].first) + "-" + std::to_string(ranges_[i].second) + "/" + total + "\r\n\r\n";
+            heads.push_back(multipart_.size());
+        }
+        multipart_ += std::string("\r\n--") + BOUNDARY + "--\r\n";
+
+        // multipart_构造完成后不再修改，分段才能指向其内部
+        size_t length = multipart_.size(), headBegin = 0;
+        for(size_t i = 0; i < ranges_.size(); i++) {
+            body_.push_back({multipart_.data() + headBegin, -1, 0, heads[i] - headBegin});
+            addFileSegment_(ranges_[i].first, ranges_[i].second + 1);
+            length += ranges_[i].second - ranges_[i].first + 1;
+            headBegin = heads[i];
+        }
+        body_.push_back({multipart_.data() + headBegin, -1, 0, multipart_.size() - headBegin});
+        buffer.Append("Content-length: " + std::to_string(length) + "\r\n\r\n");
+    } else {
+        buffer.Append("Content-length: " + total + "\r\n\r\n");
+        addFileSegment_(0, file_->size());
+    }
+}
+
+void HttpResponse::addFileSegment_(size_t begin, size_t end) {
+    assert(file_ && begin <= end && end <= file_->size());
+    if(begin == end) {
         return;
     }
+    if(file_->addr) {
+        body_.push_back({file_->addr + begin, -1, 0, end - begin});
+    } else {
+        body_.push_back({nullptr, file_->fd, begin, end - begin});
+    }
+}
+
+std::string HttpResponse::httpDate_(time_t t) {
+    char buf[64];
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    size_t n = strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return std::string(buf, n);
+}
+
+// If-Range为实体标签时与ETag做强比较(弱标签永不匹配)，为HTTP-date时必须与文件的修改时间完全一致
+bool HttpResponse::matchIfRange_(const std::string& ifRange) const {
+    if(ifRange[0] == '"' || ifRange.compare(0, 2, "W/") == 0) {
+        return ifRange == etag_;
+    }
+    return ifRange == httpDate_(lastModified_);
+}
+
+// 解析一个十进制数，没有数字时返回false
+static bool ParseRangeNumber(const char *&p, const char *end, size_t *value) {
+    const char *begin = p;
+    *value = 0;
+    while(p < end && isdigit(*p)) {
+        if(*value > (SIZE_MAX - 9) / 10) {
+            return false;
+        }
+        *value = *value * 10 + (*p - '0');
+        p++;
+    }
+    return p != begin;
+}
+
+/*  解析Range: bytes=<first>-<last>, <first>-, -<suffix>, ...
+    语法错误或验证器不匹配时忽略Range，返回整个文件(200)；
+    语法正确但没有一个区间落在文件内时返回416
+*/
+void HttpResponse::parseRange_() {
+    if(request_ == nullptr || request_->method() != "GET") {
+        return;
+    }
+    const std::string& range = request_->GetHeader("Range");
+    if(range.compare(0, 6, "bytes=") != 0) {
+        return;
+    }
+    const std::string& ifRange = request_->GetHeader("If-Range");
+    if(!ifRange.empty() && !matchIfRange_(ifRange)) {
+        // 文件已变化，返回完整的新文件
+        return;
+    }
+
+    size_t size = file_->size();
+    size_t specs = 0;   // 语法正确的区间数
+    const char *p = range.data() + 6, *end = range.data() + range.size();
+    while(p < end) {
+        while(p < end && (*p == ' ' || *p == '\t' || *p == ',')) {
+            p++;
+        }
+        if(p == end) {
+            break;
+        }
+        size_t first, last;
+        bool hasFirst = ParseRangeNumber(p, end, &first);
+        if(p == end || *p != '-') {
+            ranges_.clear();
+            return;
+        }
+        p++;
+        bool hasLast = ParseRangeNumber(p, end, &last);
+        while(p < end && (*p == ' ' || *p == '\t')) {
+            p++;
+        }
+        if((!hasFirst && !hasLast) || (p < end && *p != ',') || (hasFirst && hasLast && last < first)) {
+            ranges_.clear();
+            return;
+        }
+        if(++specs > MAX_RANGES) {
+            ranges_.clear();
+            return;
+        }
+
+        if(!hasFirst) {
+            // -<suffix>：最后suffix个字节
+            if(last == 0 || size == 0) {
+                continue;
+            }
+            first = last >= size ? 0 : size - last;
+            last = size - 1;
+        } else {
+            if(first >= size) {
+                // 起点超出文件范围，该区间不可满足
+                continue;
+            }
+            if(!hasLast || last >= size) {
+                last = size - 1;
+            }
+        }
+        ranges_.emplace_back(first, last);
+    }
 
-    // 将文件映射到内存，采用写时拷贝的私有映射，对其他进程不可见，返回内存映射的首地址
-    void *mmapAddr = mmap(NULL, mmapFileStat_.st_size, PROT_READ, MAP_PRIVATE, srcFd, 0);
-    if(mmapAddr == MAP_FAILED) {
-        errorContent(buffer, "File Not Found, MMAP Failed!");
+    if(specs == 0) {
         return;
     }
-    mmapFile_ = (char *)mmapAddr;
-    close(srcFd);
-    buffer.Append("Content-length: " + std::to_string(mmapFileStat_.st_size) + "\r\n\r\n");
+    stateCode_ = ranges_.empty() ? 416 : 206;
 }
 
 std::string HttpResponse::getFileType() {
@@ -0,0 +1,277 @@
+#include "../include/iouring.hpp"
+
+const uint64_t IoUring::REMOVE_TAG;
+const uint64_t IoUring::WAKE_TAG;
+
+IoUring::IoUring(int maxEvent, unsigned entries) 
+    : ringFd_(-1), sqRing_(MAP_FAILED), sqRingSize_(0), sqes_(static_cast<struct io_uring_sqe *>(MAP_FAILED)), sqesSize_(0), 
+    localTail_(0), cqRing_(MAP_FAILED), cqRingSize_(0), wakeFd_(eventfd(0, EFD_CLOEXEC)), wakeCount_(0), 
+    events_(maxEvent), eventCnt_(0) {
+    assert(events_.size() > 0);
+    if(!setup_(entries) && ringFd_ >= 0) {
+        close(ringFd_);
+        ringFd_ = -1;
+    }
+    if(ringFd_ >= 0) {
+        readWake_();
+    }
+}
+
+IoUring::~IoUring() {
+    // 关闭ring时内核取消所有挂起的poll
+    if(sqes_ != MAP_FAILED) {
+        munmap(sqes_, sqesSize_);
+    }
+    if(cqRing_ != MAP_FAILED && cqRing_ != sqRing_) {
+        munmap(cqRing_, cqRingSize_);
+    }
+    if(sqRing_ != MAP_FAILED) {
+        munmap(sqRing_, sqRingSize_);
+    }
+    if(ringFd_ >= 0) {
+        close(ringFd_);
+    }
+    if(wakeFd_ >= 0) {
+        close(wakeFd_);
+    }
+}
+
+bool IoUring::setup_(unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ringFd_ = syscall(__NR_io_uring_setup, entries, &params);
+    if(ringFd_ < 0 || wakeFd_ < 0) {
+        // 内核不支持或被禁用(io_uring_disabled、seccomp)
+        return false;
+    }
+    // 多次poll需要5.13+(以同版本加入的RSRC_TAGS判断)，带超时的等待需要EXT_ARG
+    const uint32_t required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG | IORING_FEAT_RSRC_TAGS;
+    if((params.features & required) != required) {
+        return false;
+    }
+
+    // 提交队列和完成队列的环共用一次映射
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+    sqRing_ = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQ_RING);
+    if(sqRing_ == MAP_FAILED) {
+        return false;
+    }
+    cqRing_ = sqRing_;
+    sqesSize_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    void *sqes = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQES);
+    if(sqes == MAP_FAILED) {
+        return false;
+    }
+    sqes_ = static_cast<struct io_uring_sqe *>(sqes);
+
+    char *sq = static_cast<char *>(sqRing_);
+    sqHead_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sqMask_ = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sqArray_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    sqEntries_ = params.sq_entries;
+    char *cq = static_cast<char *>(cqRing_);
+    cqHead_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cqMask_ = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+
+    // 提交队列项与索引一一对应
+    for(unsigned i = 0; i < sqEntries_; i++) {
+        sqArray_[i] = i;
+    }
+    localTail_ = *sqTail_;
+    return true;
+}
+
+IoUring::Reg &IoUring::reg_(int fd) {
+    if(static_cast<size_t>(fd) >= regs_.size()) {
+        regs_.resize(std::max(static_cast<size_t>(fd) + 1, regs_.size() * 2));
+    }
+    return regs_[fd];
+}
+
+struct io_uring_sqe *IoUring::getSqe_() {
+    if(localTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) >= sqEntries_) {
+        // 提交队列满，先交给内核
+        submit_();
+        if(localTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) >= sqEntries_) {
+            return nullptr;
+        }
+    }
+    struct io_uring_sqe *sqe = &sqes_[localTail_ & *sqMask_];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+void IoUring::pollAdd_(int fd, Reg &reg) {
+    struct io_uring_sqe *sqe = getSqe_();
+    if(!sqe) {
+        reg.armed = false;
+        return;
+    }
+    reg.seq++;
+    reg.armed = true;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    // 触发方式由请求类型体现，不属于poll的事件掩码
+    sqe->poll32_events = reg.events & ~(EPOLLONESHOT | EPOLLET | EPOLLEXCLUSIVE);
+    if((reg.events & EPOLLET) && !(reg.events & EPOLLONESHOT)) {
+        sqe->len = IORING_POLL_ADD_MULTI;
+    }
+    sqe->user_data = (uint64_t)reg.seq << 32 | (uint32_t)fd;
+    // 写好请求后再发布尾位置
+    __atomic_store_n(sqTail_, ++localTail_, __ATOMIC_RELEASE);
+}
+
+void IoUring::pollRemove_(int fd, Reg &reg) {
+    if(!reg.armed) {
+        return;
+    }
+    uint64_t target = (uint64_t)reg.seq << 32 | (uint32_t)fd;
+    // 序号加1：被取消的poll若已经完成，其完成事件也会被丢弃
+    reg.seq++;
+    reg.armed = false;
+    struct io_uring_sqe *sqe = getSqe_();
+    if(!sqe) {
+        return;
+    }
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->user_data = REMOVE_TAG;
+    __atomic_store_n(sqTail_, ++localTail_, __ATOMIC_RELEASE);
+}
+
+void IoUring::readWake_() {
+    struct io_uring_sqe *sqe = getSqe_();
+    if(!sqe) {
+        return;
+    }
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = wakeFd_;
+    sqe->addr = reinterpret_cast<uint64_t>(&wakeCount_);
+    sqe->len = sizeof(wakeCount_);
+    sqe->user_data = WAKE_TAG;
+    __atomic_store_n(sqTail_, ++localTail_, __ATOMIC_RELEASE);
+}
+
+void IoUring::wakeup() {
+    uint64_t one = 1;
+    ssize_t n = write(wakeFd_, &one, sizeof(one));
+    (void)n;
+}
+
+int IoUring::submit_() {
+    unsigned toSubmit = localTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    if(toSubmit == 0) {
+        return 0;
+    }
+    return syscall(__NR_io_uring_enter, ringFd_, toSubmit, 0, 0, nullptr, 0);
+}
+
+bool IoUring::addFd(int fd, uint32_t events, uint64_t data) {
+    if(fd < 0) {
+        return false;
+    }
+    Reg &reg = reg_(fd);
+    pollRemove_(fd, reg);
+    reg.data = data;
+    reg.events = events;
+    pollAdd_(fd, reg);
+    return reg.armed;
+}
+
+bool IoUring::modFd(int fd, uint32_t events, uint64_t data) {
+    // poll请求无法原地修改，重新提交
+    return addFd(fd, events, data);
+}
+
+bool IoUring::rmFd(int fd) {
+    if(fd < 0) {
+        return false;
+    }
+    if(static_cast<size_t>(fd) >= regs_.size()) {
+        return false;
+    }
+    Reg &reg = regs_[fd];
+    pollRemove_(fd, reg);
+    reg.events = 0;
+    return true;
+}
+
+int IoUring::wait(int timeMS) {
+    unsigned toSubmit = localTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    // 已有完成事件时只提交不等待；攒下的注册和等待合并为一次系统调用
+    bool ready = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE) != *cqHead_;
+    unsigned minComplete = (ready || timeMS == 0) ? 0 : 1;
+    if(toSubmit > 0 || minComplete > 0) {
+        int ret;
+        unsigned flags = minComplete > 0 ? IORING_ENTER_GETEVENTS : 0;
+        if(minComplete > 0 && timeMS > 0) {
+            struct __kernel_timespec ts;
+            ts.tv_sec = timeMS / 1000;
+            ts.tv_nsec = (timeMS % 1000) * 1000000LL;
+            struct io_uring_getevents_arg arg;
+            memset(&arg, 0, sizeof(arg));
+            arg.ts = reinterpret_cast<uint64_t>(&ts);
+            ret = syscall(__NR_io_uring_enter, ringFd_, toSubmit, minComplete, flags | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+        } else {
+            ret = syscall(__NR_io_uring_enter, ringFd_, toSubmit, minComplete, flags, nullptr, 0);
+        }
+        if(ret < 0 && errno != ETIME && errno != EINTR) {
+            return -1;
+        }
+    }
+
+    unsigned head = *cqHead_;
+    unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    eventCnt_ = 0;
+    while(head != tail && eventCnt_ < events_.size()) {
+        const struct io_uring_cqe *cqe = &cqes_[head & *cqMask_];
+        head++;
+        if(cqe->user_data == REMOVE_TAG) {
+            continue;
+        }
+        if(cqe->user_data == WAKE_TAG) {
+            // 被唤醒：计数已由READ请求读走，重新提交
+            readWake_();
+            continue;
+        }
+        int fd = (int)(uint32_t)cqe->user_data;
+        uint32_t seq = cqe->user_data >> 32;
+        if(static_cast<size_t>(fd) >= regs_.size()) {
+            continue;
+        }
+        Reg &reg = regs_[fd];
+        if(!reg.armed || reg.seq != seq) {
+            // 已被取代或删除的poll
+            continue;
+        }
+        bool more = cqe->flags & IORING_CQE_F_MORE;
+        if(!more) {
+            reg.armed = false;
+        }
+        events_[eventCnt_].data = reg.data;
+        events_[eventCnt_].events = cqe->res < 0 ? EPOLLERR : (uint32_t)cqe->res;
+        eventCnt_++;
+        if(!more && !(reg.events & EPOLLONESHOT)) {
+            // 持久注册：事件交出后重新提交，在下一次wait()时随等待一起提交
+            pollAdd_(fd, reg);
+        }
+    }
+    __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+    return eventCnt_;
+}
+
+uint64_t IoUring::getEventData(size_t i) const {
+    assert(i < eventCnt_);
+    return events_[i].data;
+}
+
+uint32_t IoUring::getEvents(size_t i) const {
+    assert(i < eventCnt_);
+    return events_[i].events;
+}
\ No newline at end of file
@@ -0,0 +1,210 @@
+#include "../include/metrics.hpp"
+#include <cstdio>
+#include <cstdarg>
+#include <algorithm>
+
+const int Histogram::BUCKETS;
+const int Metrics::MIN_STATUS;
+const int Metrics::MAX_STATUS;
+const char *Metrics::PREFIX = "tinyweb_";
+thread_local Metrics::ThreadMetrics *Metrics::current_ = nullptr;
+
+void Histogram::mergeTo(Snapshot &snapshot) const {
+    for(int i = 0; i < BUCKETS; i++) {
+        uint64_t n = buckets_[i].load(std::memory_order_relaxed);
+        snapshot.buckets[i] += n;
+        snapshot.count += n;
+    }
+    snapshot.sum += sum_.load(std::memory_order_relaxed);
+}
+
+uint64_t Histogram::Snapshot::countBelow(uint64_t bound) const {
+    uint64_t n = 0;
+    for(int i = 0; i < BUCKETS && upperBound(i) <= bound; i++) {
+        n += buckets[i];
+    }
+    return n;
+}
+
+uint64_t Histogram::Snapshot::quantile(double q) const {
+    if(count == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(q * count);
+    if(rank >= count) {
+        rank = count - 1;
+    }
+    uint64_t seen = 0;
+    for(int i = 0; i < BUCKETS; i++) {
+        seen += buckets[i];
+        if(seen > rank) {
+            return upperBound(i);
+        }
+    }
+    return upperBound(BUCKETS - 1);
+}
+
+Metrics::ThreadMetrics::ThreadMetrics() : accepted(0), inUse(true) {
+    for(auto &counter : status) {
+        counter.store(0, std::memory_order_relaxed);
+    }
+}
+
+Metrics &Metrics::instance() {
+    static Metrics metrics;
+    return metrics;
+}
+
+void Metrics::attach_() {
+    Metrics &self = instance();
+    {
+        std::lock_guard<std::mutex> lock(self.mtx_);
+        for(auto &metrics : self.threads_) {
+            if(!metrics->inUse) {
+                metrics->inUse = true;
+                current_ = metrics.get();
+                break;
+            }
+        }
+        if(!current_) {
+            self.threads_.emplace_back(new ThreadMetrics());
+            current_ = self.threads_.back().get();
+        }
+    }
+    // 线程退出时把计数交还，之后新建的线程接着累加，线程数不会使计数无限增长
+    struct Guard {
+        ~Guard() { detach_(current_); };
+    };
+    static thread_local Guard guard;
+    (void)guard;
+}
+
+void Metrics::detach_(ThreadMetrics *metrics) {
+    if(metrics) {
+        std::lock_guard<std::mutex> lock(instance().mtx_);
+        metrics->inUse = false;
+    }
+    current_ = nullptr;
+}
+
+void Metrics::addStatus(int code) {
+    if(code < MIN_STATUS || code > MAX_STATUS) {
+        return;
+    }
+    inc_(local_().status[code - MIN_STATUS]);
+}
+
+void Metrics::addProbe(const std::string &name, ProbeType type, const std::string &help, std::function<double()> read) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    probes_.push_back({name, type, help, std::move(read)});
+}
+
+void Metrics::clearProbes() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    probes_.clear();
+}
+
+void Metrics::append_(std::string &out, const char *format, ...) {
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if(len > 0) {
+        out.append(line, std::min<size_t>(len, sizeof(line) - 1));
+    }
+}
+
+void Metrics::renderHistogram_(std::string &out, const HistogramDesc &desc, const char *label,
+    const Histogram::Snapshot &snapshot, bool header) {
+    if(header) {
+        append_(out, "# HELP %s%s %s\n", PREFIX, desc.name, desc.help);
+        append_(out, "# TYPE %s%s histogram\n", PREFIX, desc.name);
+    }
+    // le固定取2的幂，每次抓取的桶一致；子桶只用于下面的分位数
+    for(int bits = desc.minBits; bits <= desc.maxBits; bits++) {
+        uint64_t bound = (uint64_t)1 << bits;
+        append_(out, "%s%s_bucket{%sle=\"%.9g\"} %llu\n", PREFIX, desc.name, label, bound * desc.scale,
+            (unsigned long long)snapshot.countBelow(bound));
+    }
+    append_(out, "%s%s_bucket{%sle=\"+Inf\"} %llu\n", PREFIX, desc.name, label, (unsigned long long)snapshot.count);
+    // 去掉label末尾的逗号，没有label时不输出花括号
+    std::string labels(label);
+    if(!labels.empty()) {
+        labels.back() = '}';
+        labels.insert(0, "{");
+    }
+    append_(out, "%s%s_sum%s %.9g\n", PREFIX, desc.name, labels.c_str(), snapshot.sum * desc.scale);
+    append_(out, "%s%s_count%s %llu\n", PREFIX, desc.name, labels.c_str(), (unsigned long long)snapshot.count);
+}
+
+std::string Metrics::render() {
+    static const char *PHASE_NAMES[PHASES] = { "poll_wait", "queue_wait", "parse", "response", "write" };
+    static const double QUANTILES[] = { 0.5, 0.9, 0.99, 0.999 };
+    static const HistogramDesc PHASE_DESC = {
+        "phase_seconds", "Time spent in each phase of request handling.", 1e-9, 7, 34 };    // 128ns~17s
+    static const HistogramDesc BYTES_DESC = {
+        "write_bytes", "Bytes sent by each sendmsg/sendfile call.", 1, 6, 26 };   // 64B~64MB
+    static const HistogramDesc DEPTH_DESC = {
+        "pool_queue_depth", "Thread pool queue depth seen when posting a task.", 1, 0, 16 };
+
+    Histogram::Snapshot phases[PHASES];
+    Histogram::Snapshot bytesSent;
+    Histogram::Snapshot queueDepth;
+    uint64_t status[MAX_STATUS - MIN_STATUS + 1] = {0};
+    uint64_t accepted = 0;
+    std::vector<Probe> probes;
+    {
+        // 合并各线程的计数；写入方不加锁，读到的是各计数某一时刻的值
+        std::lock_guard<std::mutex> lock(mtx_);
+        for(auto &metrics : threads_) {
+            for(int i = 0; i < PHASES; i++) {
+                metrics->phases[i].mergeTo(phases[i]);
+            }
+            metrics->bytesSent.mergeTo(bytesSent);
+            metrics->queueDepth.mergeTo(queueDepth);
+            for(int i = 0; i <= MAX_STATUS - MIN_STATUS; i++) {
+                status[i] += metrics->status[i].load(std::memory_order_relaxed);
+            }
+            accepted += metrics->accepted.load(std::memory_order_relaxed);
+        }
+        probes = probes_;
+    }
+
+    std::string out;
+    out.reserve(16 << 10);
+    char label[64];
+    for(int i = 0; i < PHASES; i++) {
+        snprintf(label, sizeof(label), "phase=\"%s\",", PHASE_NAMES[i]);
+        renderHistogram_(out, PHASE_DESC, label, phases[i], i == 0);
+    }
+    // 由子桶估计的分位数(桶的上界，相对误差不超过25%)
+    append_(out, "# HELP %sphase_quantile_seconds Estimated latency quantiles of each phase.\n", PREFIX);
+    append_(out, "# TYPE %sphase_quantile_seconds gauge\n", PREFIX);
+    for(int i = 0; i < PHASES; i++) {
+        for(double q : QUANTILES) {
+            append_(out, "%sphase_quantile_seconds{phase=\"%s\",quantile=\"%g\"} %.9g\n", PREFIX, PHASE_NAMES[i], q,
+                phases[i].quantile(q) * PHASE_DESC.scale);
+        }
+    }
+    renderHistogram_(out, BYTES_DESC, "", bytesSent, true);
+    renderHistogram_(out, DEPTH_DESC, "", queueDepth, true);
+
+    append_(out, "# HELP %sresponses_total Responses by status code.\n", PREFIX);
+    append_(out, "# TYPE %sresponses_total counter\n", PREFIX);
+    for(int i = 0; i <= MAX_STATUS - MIN_STATUS; i++) {
+        if(status[i] > 0) {
+            append_(out, "%sresponses_total{code=\"%d\"} %llu\n", PREFIX, i + MIN_STATUS, (unsigned long long)status[i]);
+        }
+    }
+    append_(out, "# HELP %sconnections_accepted_total Accepted connections.\n", PREFIX);
+    append_(out, "# TYPE %sconnections_accepted_total counter\n", PREFIX);
+    append_(out, "%sconnections_accepted_total %llu\n", PREFIX, (unsigned long long)accepted);
+
+    for(const Probe &probe : probes) {
+        append_(out, "# HELP %s%s %s\n", PREFIX, probe.name.c_str(), probe.help.c_str());
+        append_(out, "# TYPE %s%s %s\n", PREFIX, probe.name.c_str(), probe.type == COUNTER ? "counter" : "gauge");
+        append_(out, "%s%s %.15g\n", PREFIX, probe.name.c_str(), probe.read());
+    }
+    return out;
+}
\ No newline at end of file
@@ -0,0 +1,15 @@
+#include "../include/poller.hpp"
+#include "../include/epoll.hpp"
+#include "../include/iouring.hpp"
+#include <iostream>
+
+std::unique_ptr<Poller> Poller::create(Backend backend, int maxEvent) {
+    if(backend == IO_URING) {
+        std::unique_ptr<IoUring> ring(new IoUring(maxEvent));
+        if(ring->valid()) {
+            return ring;
+        }
+        std::cout << "io_uring unavailable, fall back to epoll" << std::endl;
+    }
+    return std::unique_ptr<Poller>(new Epoll(maxEvent));
+}
\ No newline at end of file
@@ -0,0 +1,258 @@
+#include "../include/ratelimit.hpp"
+#include <algorithm>
+#include <new>
+#include <cstdlib>
+
+const int RateLimiter::SHARDS;
+const int RateLimiter::SHARD_SIZE;
+const int RateLimiter::MAX_PROBE;
+const int RateLimiter::MAX_BURST;
+const int RateLimiter::CONN_BITS;
+const uint64_t RateLimiter::CONN_MASK;
+const int RateLimiter::TOKEN_BITS;
+const uint64_t RateLimiter::TOKEN_MASK;
+
+// 按缓存行对齐分配(C++14的new不保证超过16字节的对齐)
+static void *alignedAlloc(size_t bytes) {
+    void *mem = nullptr;
+    if(posix_memalign(&mem, 64, bytes) != 0) {
+        throw std::bad_alloc();
+    }
+    return mem;
+}
+
+RateLimiter::RateLimiter(const RateLimitOptions &options) 
+    : options_(options), startMS_(clockMS_()), burstMilli_(0), shards_(nullptr), rejected_(0) {
+    if(options_.burst <= 0) {
+        options_.burst = options_.requestsPerSec;
+    }
+    options_.burst = std::min(options_.burst, MAX_BURST);
+    burstMilli_ = (int64_t)options_.burst * 1000;
+    if(limitsConns() || limitsRequests()) {
+        // 未开启任何限制时不分配表
+        shards_ = static_cast<Shard *>(alignedAlloc(sizeof(Shard) * SHARDS));
+        for(int i = 0; i < SHARDS; i++) {
+            new (&shards_[i]) Shard();
+            shards_[i].entries = static_cast<Entry *>(alignedAlloc(sizeof(Entry) * SHARD_SIZE));
+            for(int j = 0; j < SHARD_SIZE; j++) {
+                new (&shards_[i].entries[j]) Entry();   // 值初始化，两个字均为0
+            }
+        }
+    }
+    const std::string body = "Too Many Requests\n";
+    response_ = "HTTP/1.1 429 Too Many Requests\r\n"
+        "Retry-After: 1\r\n"
+        "Content-Type: text/plain\r\n"
+        "Content-Length: " + std::to_string(body.size()) + "\r\n"
+        "Connection: close\r\n\r\n" + body;
+}
+
+RateLimiter::~RateLimiter() {
+    if(shards_) {
+        for(int i = 0; i < SHARDS; i++) {
+            free(shards_[i].entries);
+            shards_[i].~Shard();
+        }
+        free(shards_);
+    }
+}
+
+uint64_t RateLimiter::hash_(uint64_t key) {
+    // splitmix64的混合函数，低位选分片，其余位选起始表项
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ULL;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebULL;
+    key ^= key >> 31;
+    return key;
+}
+
+uint64_t RateLimiter::clockMS_() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+int64_t RateLimiter::elapsed_(uint64_t now, uint64_t stamp) {
+    // 36位的差按有符号数解释：其他线程可能已写入比本线程读到的时刻稍晚的时间戳
+    return (int64_t)((now - stamp) << TOKEN_BITS) >> TOKEN_BITS;
+}
+
+bool RateLimiter::idle_(uint64_t slot, uint64_t bucket, uint64_t now) const {
+    return (slot & CONN_MASK) == 0 && elapsed_(now, bucket >> TOKEN_BITS) > (int64_t)options_.idleSec * 1000;
+}
+
+void RateLimiter::lock_(Shard &shard) {
+    while(shard.lock.test_and_set(std::memory_order_acquire)) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+}
+
+RateLimiter::Entry *RateLimiter::lookup_(Shard &shard, uint64_t key, uint64_t h) {
+    for(int i = 0; i < MAX_PROBE; i++) {
+        Entry &entry = shard.entries[(h + i) & (SHARD_SIZE - 1)];
+        uint64_t slot = entry.slot.load(std::memory_order_acquire);
+        if(slot >> CONN_BITS == key) {
+            return &entry;
+        }
+        if(slot == 0) {
+            // 表项从不清空，key不会出现在空位之后
+            break;
+        }
+    }
+    return nullptr;
+}
+
+RateLimiter::Entry *RateLimiter::find_(Shard &shard, uint64_t key, uint64_t h, uint64_t now) {
+    Entry *entry = lookup_(shard, key, h);
+    if(entry) {
+        return entry;
+    }
+    // 新地址：同一分片的插入串行进行
+    lock_(shard);
+    entry = insert_(shard, key, h, now);
+    unlock_(shard);
+    return entry;
+}
+
+RateLimiter::Entry *RateLimiter::insert_(Shard &shard, uint64_t key, uint64_t h, uint64_t now) {
+    Entry *reusable = nullptr;
+    uint64_t expected = 0;
+    for(int i = 0; i < MAX_PROBE; i++) {
+        Entry &entry = shard.entries[(h + i) & (SHARD_SIZE - 1)];
+        uint64_t slot = entry.slot.load(std::memory_order_acquire);
+        if(slot >> CONN_BITS == key) {
+            // 其他线程在本线程加锁前已插入
+            return &entry;
+        }
+        if(slot == 0) {
+            if(!reusable) {
+                reusable = &entry;
+                expected = 0;
+            }
+            break;
+        }
+        if(!reusable && idle_(slot, entry.bucket.load(std::memory_order_relaxed), now)) {
+            // 空闲过期的表项，key不在后面时复用
+            reusable = &entry;
+            expected = slot;
+        }
+    }
+    // 空位只在持锁时写入；复用时若旧地址恰好并发计入了连接，CAS失败，放弃复用
+    if(!reusable || !reusable->slot.compare_exchange_strong(expected, key << CONN_BITS, std::memory_order_acq_rel)) {
+        return nullptr;
+    }
+    // 在换key之后才重置令牌桶，其间查到新key的线程按旧时间戳补充令牌(已空闲超过idleSec，通常已满)
+    reusable->bucket.store(makeBucket_(now, burstMilli_), std::memory_order_relaxed);
+    return reusable;
+}
+
+bool RateLimiter::addConn_(uint64_t key, int limit, bool *charged) {
+    *charged = false;
+    uint64_t h = hash_(key);
+    Shard &shard = shards_[h & (SHARDS - 1)];
+    Entry *entry = find_(shard, key, h >> 6, nowMS_());
+    if(!entry) {
+        // 表已满：放行，不计入
+        return true;
+    }
+    uint64_t slot = entry->slot.load(std::memory_order_relaxed);
+    // 查到后表项可能被复用(key已改变)，此时放行
+    while(slot >> CONN_BITS == key) {
+        uint64_t conns = slot & CONN_MASK;
+        if((limit > 0 && conns >= (uint64_t)limit) || conns == CONN_MASK) {
+            return false;
+        }
+        if(entry->slot.compare_exchange_weak(slot, slot + 1, std::memory_order_relaxed)) {
+            *charged = true;
+            return true;
+        }
+    }
+    return true;
+}
+
+void RateLimiter::removeConn_(uint64_t key) {
+    uint64_t h = hash_(key);
+    Shard &shard = shards_[h & (SHARDS - 1)];
+    // 连接数大于0的表项不会被复用，计入过的表项一定还在
+    Entry *entry = lookup_(shard, key, h >> 6);
+    if(!entry) {
+        return;
+    }
+    uint64_t slot = entry->slot.load(std::memory_order_relaxed);
+    while(slot >> CONN_BITS == key && (slot & CONN_MASK) > 0) {
+        if(entry->slot.compare_exchange_weak(slot, slot - 1, std::memory_order_relaxed)) {
+            return;
+        }
+    }
+}
+
+bool RateLimiter::acquireConn(in_addr_t ip, ConnToken *token) {
+    *token = ConnToken();
+    if(!limitsConns()) {
+        return true;
+    }
+    if(options_.maxConnsPerIP > 0 && !addConn_(ipKey_(ip), options_.maxConnsPerIP, &token->ip)) {
+        rejected_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    if(options_.maxConnsPerSubnet > 0 && !addConn_(subnetKey_(ip), options_.maxConnsPerSubnet, &token->subnet)) {
+        // 撤销已计入的IP连接数
+        if(token->ip) {
+            removeConn_(ipKey_(ip));
+            token->ip = false;
+        }
+        rejected_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+void RateLimiter::releaseConn(in_addr_t ip, const ConnToken &token) {
+    // 表满时放行的连接没有计入，不能减少(否则会扣掉同一地址之后计入的其他连接)
+    if(token.ip) {
+        removeConn_(ipKey_(ip));
+    }
+    if(token.subnet) {
+        removeConn_(subnetKey_(ip));
+    }
+}
+
+bool RateLimiter::allowRequest(in_addr_t ip) {
+    if(!limitsRequests()) {
+        return true;
+    }
+    uint64_t key = ipKey_(ip);
+    uint64_t h = hash_(key);
+    uint64_t now = nowMS_();
+    Shard &shard = shards_[h & (SHARDS - 1)];
+    bool allowed = true;
+    Entry *entry = find_(shard, key, h >> 6, now);
+    if(entry) {
+        uint64_t bucket = entry->bucket.load(std::memory_order_relaxed);
+        while(true) {
+            uint64_t stamp = bucket >> TOKEN_BITS;
+            int64_t milliTokens = bucket & TOKEN_MASK;
+            int64_t elapsed = elapsed_(now, stamp);
+            if(elapsed > 0) {
+                // 按经过的时间补充令牌(每秒requestsPerSec个，即每毫秒requestsPerSec个千分之一令牌)，不超过桶容量
+                milliTokens = std::min(burstMilli_, milliTokens + std::min(elapsed, burstMilli_) * options_.requestsPerSec);
+                stamp = now;
+            }
+            allowed = milliTokens >= 1000;
+            if(allowed) {
+                milliTokens -= 1000;
+            }
+            uint64_t next = makeBucket_(stamp, milliTokens);
+            if(next == bucket || entry->bucket.compare_exchange_weak(bucket, next, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+    }
+    if(!allowed) {
+        rejected_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return allowed;
+}
\ No newline at end of file
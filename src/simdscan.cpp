@@ -0,0 +1,171 @@
+#include "../include/simdscan.hpp"
+
+#include <cstring>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_SCAN_X86
+#endif
+
+/*  标量实现
+    findChar直接使用memchr(glibc内部已做向量化)
+*/
+static const char *ScalarFindCRLF(const char *begin, const char *end) {
+    for(const char *p = begin; p + 1 < end; p++) {
+        if(p[0] == '\r' && p[1] == '\n') {
+            return p;
+        }
+    }
+    return end;
+}
+
+static const char *ScalarFindChar(const char *begin, const char *end, char ch) {
+    if(begin >= end) {
+        return end;
+    }
+    const void *p = memchr(begin, ch, end - begin);
+    return p ? static_cast<const char*>(p) : end;
+}
+
+static const char *ScalarFindCtl(const char *begin, const char *end) {
+    for(const char *p = begin; p < end; p++) {
+        if(static_cast<unsigned char>(*p) <= 0x20) {
+            return p;
+        }
+    }
+    return end;
+}
+
+#ifdef SIMD_SCAN_X86
+/*  SSE2实现：每次比较16字节，movemask得到命中位图，取最低位即第一个命中位置
+    查找\r\n时，同时比较p处的'\r'和p+1处的'\n'，两个位图相与
+*/
+__attribute__((target("sse2")))
+static const char *Sse2FindCRLF(const char *begin, const char *end) {
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const char *p = begin;
+    for(; p + 17 <= end; p += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 1));
+        int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, cr), _mm_cmpeq_epi8(b, lf)));
+        if(mask) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return ScalarFindCRLF(p, end);
+}
+
+__attribute__((target("sse2")))
+static const char *Sse2FindChar(const char *begin, const char *end, char ch) {
+    const __m128i c = _mm_set1_epi8(ch);
+    const char *p = begin;
+    for(; p + 16 <= end; p += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(a, c));
+        if(mask) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return ScalarFindChar(p, end, ch);
+}
+
+// 无符号比较 x <= 0x20 等价于 min(x, 0x20) == x
+__attribute__((target("sse2")))
+static const char *Sse2FindCtl(const char *begin, const char *end) {
+    const __m128i sp = _mm_set1_epi8(0x20);
+    const char *p = begin;
+    for(; p + 16 <= end; p += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(a, sp), a));
+        if(mask) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return ScalarFindCtl(p, end);
+}
+
+// AVX2实现：与SSE2相同，每次比较32字节
+__attribute__((target("avx2")))
+static const char *Avx2FindCRLF(const char *begin, const char *end) {
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const char *p = begin;
+    for(; p + 33 <= end; p += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 1));
+        unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, cr), _mm256_cmpeq_epi8(b, lf)));
+        if(mask) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return Sse2FindCRLF(p, end);
+}
+
+__attribute__((target("avx2")))
+static const char *Avx2FindChar(const char *begin, const char *end, char ch) {
+    const __m256i c = _mm256_set1_epi8(ch);
+    const char *p = begin;
+    for(; p + 32 <= end; p += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, c));
+        if(mask) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return Sse2FindChar(p, end, ch);
+}
+
+__attribute__((target("avx2")))
+static const char *Avx2FindCtl(const char *begin, const char *end) {
+    const __m256i sp = _mm256_set1_epi8(0x20);
+    const char *p = begin;
+    for(; p + 32 <= end; p += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(a, sp), a));
+        if(mask) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return Sse2FindCtl(p, end);
+}
+#endif
+
+const SimdScan::Impl &SimdScan::scalar() {
+    static const Impl impl = {"scalar", ScalarFindCRLF, ScalarFindChar, ScalarFindCtl};
+    return impl;
+}
+
+const SimdScan::Impl *SimdScan::sse2() {
+#ifdef SIMD_SCAN_X86
+    static const Impl impl = {"sse2", Sse2FindCRLF, Sse2FindChar, Sse2FindCtl};
+    if(__builtin_cpu_supports("sse2")) {
+        return &impl;
+    }
+#endif
+    return nullptr;
+}
+
+const SimdScan::Impl *SimdScan::avx2() {
+#ifdef SIMD_SCAN_X86
+    static const Impl impl = {"avx2", Avx2FindCRLF, Avx2FindChar, Avx2FindCtl};
+    if(__builtin_cpu_supports("avx2")) {
+        return &impl;
+    }
+#endif
+    return nullptr;
+}
+
+const SimdScan::Impl *SimdScan::select_() {
+#ifdef SIMD_SCAN_X86
+    __builtin_cpu_init();
+#endif
+    if(avx2()) {
+        return avx2();
+    }
+    if(sse2()) {
+        return sse2();
+    }
+    return &scalar();
+}
+
+const SimdScan::Impl *SimdScan::impl_ = SimdScan::select_();
\ No newline at end of file
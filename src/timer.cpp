@@ -1,137 +1,249 @@
 #include "../include/timer.hpp"
 
-/*  此处使用vector构造的小顶堆(完全二叉树)
-    父节点索引为x，左节点为2x+1，右节点为2x+2
-*/
-void TimerManager::swapNode(size_t i, size_t j) {
-    assert(i >= 0 && i < heapTimer_.size());
-    assert(j >= 0 && j < heapTimer_.size());
-    // 交换堆中的两个定时器节点
-    std::swap(heapTimer_[i], heapTimer_[j]);
-    // 更新哈希表中定时器id在堆中的索引下标
-    ref_[heapTimer_[i].id] = i;
-    ref_[heapTimer_[j].id] = j;
-}
-
-void TimerManager::siftup(size_t i) {
-    assert(i >= 0 && i < heapTimer_.size());
-    int j = (i - 1) / 2;  // 获取节点i的父节点
-    while(j >= 0) {
-        // 利用重载的operator<
-        if(heapTimer_[j] < heapTimer_[i]) {
-            break;
+const uint64_t TimerManager::ROOT_SIZE;
+const uint64_t TimerManager::LEVEL_SIZE;
+const uint64_t TimerManager::MAX_SPAN;
+
+TimerManager::TimerManager(int slackMS) : count_(0), 
+    timerfd_(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)), 
+    slack_(slackMS > 0 ? slackMS : 1), armed_(0) {
+    assert(timerfd_ >= 0);
+    // 每个槽的哨兵自成一个空的循环链表
+    for(TimerLink &slot : root_) {
+        slot.prev = slot.next = &slot;
+    }
+    for(auto &level : levels_) {
+        for(TimerLink &slot : level) {
+            slot.prev = slot.next = &slot;
         }
-        // 父节点>子节点时长，交换
-        swapNode(i, j);
-        i = j;  // 新索引
-        j = (i - 1) / 2;  // 新父节点索引
     }
+    tick();
+    current_ = now_;
 }
 
-void TimerManager::siftdown(size_t i) {
-    int n = heapTimer_.size();
-    assert(i >= 0 && i < n);
-    int j = 2 * i + 1;  // 获取左子节点
-    while(j < n) {
-        if(heapTimer_[i] < heapTimer_[j]) {
-            break;
-        }
-        if((j + 1 < n) && heapTimer_[j + 1] < heapTimer_[j]) {
-            // 取左、右子节点中的min
-            ++j;
-        }
-        // 交换节点i和节点min
-        swapNode(i, j);
-        // 更新索引
-        i = j;
-        j = 2 * i + 1;
-    }
-}
-
-void TimerManager::addTimer(int id, int timewait, const TimeoutCallBack& cbfunc) {
-    assert(id >= 0);
-    size_t i;
-    if(ref_.count(id) == 0) {
-        // 新节点，插在堆尾，siftup()调整堆
-        i = heapTimer_.size();
-        ref_[id] = i;
-        heapTimer_.push_back({id, CLOCK::now() + MS(timewait), cbfunc});
-        siftup(i);
+TimerManager::~TimerManager() {
+    clear();
+    close(timerfd_);
+}
+
+void TimerManager::tick() {
+    now_ = std::chrono::duration_cast<MS>(CLOCK::now().time_since_epoch()).count();
+}
+
+void TimerManager::append_(TimerLink *slot, TimerLink *link) {
+    link->prev = slot->prev;
+    link->next = slot;
+    slot->prev->next = link;
+    slot->prev = link;
+}
+
+void TimerManager::place_(TimerNode *node) {
+    uint64_t expire = node->expire;
+    if(expire < current_) {
+        // 已过期，放入下一个待处理的槽
+        expire = current_;
+    } else if(expire - current_ >= MAX_SPAN) {
+        // 超出时间轮的范围，按最长定时处理
+        expire = current_ + MAX_SPAN - 1;
+    }
+    uint64_t delta = expire - current_;
+    if(delta < ROOT_SIZE) {
+        append_(&root_[expire & (ROOT_SIZE - 1)], node);
+        return;
+    }
+    // 找到能容纳delta的最低一层
+    int level = 0;
+    int shift = ROOT_BITS;
+    while(delta >= ((uint64_t)1 << (shift + LEVEL_BITS))) {
+        level++;
+        shift += LEVEL_BITS;
+    }
+    append_(&levels_[level][(expire >> shift) & (LEVEL_SIZE - 1)], node);
+}
+
+void TimerManager::cascade_(int level) {
+    int shift = ROOT_BITS + level * LEVEL_BITS;
+    TimerLink *slot = &levels_[level][(current_ >> shift) & (LEVEL_SIZE - 1)];
+    // 取下整个槽，逐个重新放置(会落到更低的层)
+    TimerLink list;
+    if(slot->next == slot) {
+        return;
+    }
+    list.next = slot->next;
+    list.prev = slot->prev;
+    list.next->prev = list.prev->next = &list;
+    slot->prev = slot->next = slot;
+    while(list.next != &list) {
+        TimerNode *node = static_cast<TimerNode *>(list.next);
+        node->unlink();
+        place_(node);
+    }
+}
+
+void TimerManager::runSlot_(TimerLink *slot) {
+    while(slot->next != slot) {
+        // 先摘除再回调，回调中可以安全地添加、删除其他定时器或重新添加本节点
+        TimerNode *node = static_cast<TimerNode *>(slot->next);
+        node->unlink();
+        count_--;
+        node->callbackFunc();   // 关闭对应的HTTP连接
+    }
+}
+
+void TimerManager::addTimer(TimerNode *node, int timewait, const TimeoutCallBack& cbfunc) {
+    assert(node && timewait >= 0);
+    node->callbackFunc = cbfunc;
+    update(node, timewait);
+}
+
+void TimerManager::update(TimerNode *node, int timewait) {
+    assert(node && timewait >= 0);
+    if(node->linked()) {
+        node->unlink();
     } else {
-        // 已有节点，调整堆
-        i = ref_[id];
-        heapTimer_[i].timeExpire = CLOCK::now() + MS(timewait);
-        heapTimer_[i].callbackFunc = cbfunc;
-        siftup(i);
-        siftdown(i);
+        count_++;
+    }
+    node->expire = now_ + timewait;
+    place_(node);
+    if(armed_ == 0 || node->expire < armed_) {
+        // 比timerfd当前的时刻更早(如新连接)才需要重新设置；刷新通常是延后，不产生系统调用
+        arm_(node->expire);
     }
 }
 
-void TimerManager::delTimer(size_t i) {
-    assert(!heapTimer_.empty() && i >= 0 && i < heapTimer_.size());
-    int n = heapTimer_.size() - 1;
-    swapNode(i, n);
-    ref_.erase(heapTimer_.back().id);
-    heapTimer_.pop_back();
-    if(!heapTimer_.empty()) {
-        // 堆非空，调整堆
-        siftup(i);
-        siftdown(i);
+void TimerManager::del(TimerNode *node) {
+    assert(node);
+    if(node->linked()) {
+        node->unlink();
+        count_--;
     }
 }
 
-void TimerManager::work(size_t id) {
-    if(heapTimer_.empty() || ref_.count(id) == 0) {
+void TimerManager::work(TimerNode *node) {
+    assert(node);
+    if(!node->linked()) {
         return;
     }
-    int i = ref_[id];
-    TimerNode node = heapTimer_[i];
-    node.callbackFunc();
-    delTimer(i);
+    del(node);
+    node->callbackFunc();
 }
 
-void TimerManager::update(size_t id, int timewait) {
-    assert(!heapTimer_.empty() && ref_.count(id) > 0);
-    int i = ref_[id];
-    heapTimer_[i].timeExpire = CLOCK::now() + MS(timewait);
-    // 时间变长，向下调整
-    siftdown(i);
+void TimerManager::handleExpiredTimer() {
+    // 逐毫秒推进到当前时间，触发途经的槽
+    while(current_ <= now_) {
+        if(count_ == 0) {
+            // 没有定时器，直接跳到当前时间
+            current_ = now_ + 1;
+            break;
+        }
+        size_t index = current_ & (ROOT_SIZE - 1);
+        if(index == 0) {
+            // 第0层转完一圈，逐层向下分配
+            for(int level = 0; level < LEVELS - 1; level++) {
+                cascade_(level);
+                if(((current_ >> (ROOT_BITS + level * LEVEL_BITS)) & (LEVEL_SIZE - 1)) != 0) {
+                    break;
+                }
+            }
+        }
+        runSlot_(&root_[index]);
+        current_++;
+    }
 }
 
-void TimerManager::handleExpiredTimer() {
-    if(heapTimer_.empty()) {
-        return;
+void TimerManager::clear() {
+    for(TimerLink &slot : root_) {
+        while(slot.next != &slot) {
+            slot.next->unlink();
+        }
     }
-    while(!heapTimer_.empty()) {
-        TimerNode node = heapTimer_.front();
-        if(std::chrono::duration_cast<MS>(node.timeExpire - CLOCK::now()).count() > 0) {
-            // 定时未到
+    for(auto &level : levels_) {
+        for(TimerLink &slot : level) {
+            while(slot.next != &slot) {
+                slot.next->unlink();
+            }
+        }
+    }
+    count_ = 0;
+}
+
+uint64_t TimerManager::nextExpire_() const {
+    if(count_ == 0) {
+        return 0;
+    }
+    uint64_t next = 0;
+    // 第0层中最近的非空槽
+    for(uint64_t i = 0; i < ROOT_SIZE; i++) {
+        const TimerLink &slot = root_[(current_ + i) & (ROOT_SIZE - 1)];
+        if(slot.next != &slot) {
+            next = current_ + i;
             break;
         }
-        node.callbackFunc();    // 关闭对应的HTTP连接
-        pop();  // 删除到期的定时器
     }
+    /*  上层的定时器在其槽被cascade时才落到第0层，过期时间不早于该时刻
+        每层找下一个非空槽的cascade时刻(该层粒度的整数倍)，与第0层的结果取最早者
+    */
+    int shift = ROOT_BITS;
+    for(int level = 0; level < LEVELS - 1; level++, shift += LEVEL_BITS) {
+        uint64_t unit = (uint64_t)1 << shift;
+        uint64_t boundary = (current_ + unit - 1) & ~(unit - 1);
+        for(uint64_t k = 0; k < LEVEL_SIZE; k++, boundary += unit) {
+            if(next > 0 && boundary >= next) {
+                break;
+            }
+            const TimerLink &slot = levels_[level][(boundary >> shift) & (LEVEL_SIZE - 1)];
+            if(slot.next != &slot) {
+                next = boundary;
+                break;
+            }
+        }
+    }
+    return next;
 }
 
-void TimerManager::pop() {
-    assert(!heapTimer_.empty());
-    delTimer(0);  // 删除最前端的定时器
+void TimerManager::arm_(uint64_t expire) {
+    // 向上取整到slack的整数倍，使相近的到期在同一次唤醒中处理
+    expire = (expire + slack_ - 1) / slack_ * slack_;
+    if(expire == armed_) {
+        return;
+    }
+    struct itimerspec spec = {};
+    if(expire > 0) {
+        // 绝对时间：steady_clock即CLOCK_MONOTONIC
+        spec.it_value.tv_sec = expire / 1000;
+        spec.it_value.tv_nsec = (expire % 1000) * 1000000;
+    }
+    timerfd_settime(timerfd_, TFD_TIMER_ABSTIME, &spec, nullptr);
+    armed_ = expire;
 }
 
-void TimerManager::clear() {
-    ref_.clear();
-    heapTimer_.clear();
+void TimerManager::rearm_() {
+    armed_ = 0;
+    uint64_t expire = nextExpire_();
+    if(expire > 0) {
+        arm_(expire);
+    } else {
+        // 没有定时器，停止timerfd
+        struct itimerspec spec = {};
+        timerfd_settime(timerfd_, TFD_TIMER_ABSTIME, &spec, nullptr);
+    }
+}
+
+void TimerManager::handleTimerEvent() {
+    uint64_t expirations;
+    // 读出到期次数，清除可读状态
+    while(read(timerfd_, &expirations, sizeof(expirations)) > 0) {}
+    tick();
+    handleExpiredTimer();
+    rearm_();
 }
 
 int TimerManager::getNextHandle() {
+    tick();
     handleExpiredTimer();
-    int res = -1;
-    if(!heapTimer_.empty()) {
-        // 获取下一次处理的时长
-        res = std::chrono::duration_cast<MS>(heapTimer_.front().timeExpire - CLOCK::now()).count();
-        if(res < 0) {
-            res = 0;
-        }
+    uint64_t expire = nextExpire_();
+    if(expire == 0) {
+        return -1;
     }
-    return res;
+    return expire - now_;
 }
\ No newline at end of file
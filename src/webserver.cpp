@@ -1,34 +1,121 @@
 #include "../include/webserver.hpp"
 
-WebServer::WebServer(int port, int trigMode, int timewaitMS, bool isLinger, int threadNum) 
-    : port_(port), timewaitMS_(timewaitMS), isLinger_(isLinger), isClose_(false), 
-    timer_(new TimerManager()), threadpool_(new ThreadPool(threadNum)), epoll_(new Epoll()) {
+thread_local WebServer::Reactor *WebServer::current_ = nullptr;
+
+WebServer::WebServer(int port, int trigMode, int timewaitMS, bool isLinger, int threadNum, int reactorNum, int timerSlackMS, 
+    bool runInline, Poller::Backend backend, const ListenOptions &listenOptions, const AdmissionOptions &admissionOptions, 
+    const RateLimitOptions &rateLimitOptions, const AccessLogOptions &accessLogOptions) 
+    : port_(port), timewaitMS_(timewaitMS), timerSlackMS_(timerSlackMS), runInline_(runInline), isClose_(false), 
+    isLinger_(isLinger), listenOptions_(listenOptions), 
+    threadpool_(new ThreadPool(threadNum)) {
 
     srcDir_ = getcwd(nullptr, 256); // 获取当前工作路径
     assert(srcDir_);
 
     strncat(srcDir_, "/../resources/", 16); // 拼接路径
 
+    // 对端关闭后继续写socket(sendfile等)会触发SIGPIPE，忽略该信号，由返回的EPIPE处理
+    signal(SIGPIPE, SIG_IGN);
+
     // 初始化Http连接
     HttpConn::userNum = 0;
     HttpConn::srcDir = srcDir_;
 
     initEventMode_(trigMode);
-    if(!initSocket_()) {
-        // 初始化服务器socket失败
-        isClose_ = true;
+
+    // 连接数上限不超过槽位表的容量
+    AdmissionOptions admission = admissionOptions;
+    if(admission.maxConns <= 0 || admission.maxConns > MAX_FD) {
+        admission.maxConns = MAX_FD;
+    }
+    admission_.reset(new AdmissionControl(admission));
+    rateLimiter_.reset(new RateLimiter(rateLimitOptions));
+    HttpConn::limiter = rateLimiter_.get();
+    if(!accessLogOptions.path.empty()) {
+        accessLog_.reset(new AccessLog(accessLogOptions));
+        if(!accessLog_->isOpen()) {
+            std::cout << "Open access log " << accessLogOptions.path << " failed!" << std::endl;
+        }
+    }
+    HttpConn::accessLog = accessLog_ && accessLog_->isOpen() ? accessLog_.get() : nullptr;
+    addProbes_();
+
+    // 创建reactor：每个reactor各自持有一个SO_REUSEPORT监听套接字
+    if(reactorNum < 1) {
+        reactorNum = 1;
+    }
+    for(int i = 0; i < reactorNum; i++) {
+        std::unique_ptr<Reactor> reactor(new Reactor());
+        reactor->id = i;
+        reactor->listenFd = -1;
+        reactor->poller = Poller::create(backend);
+        reactor->timer.reset(new TimerManager(timerSlackMS_));
+        reactor->conns.reset(new ConnSlab(MAX_FD));
+        reactor->pending = nullptr;
+        reactor->sleeping = false;
+        if(timewaitMS_ > 0) {
+            // 定时器到期由timerfd通知
+            reactor->poller->addFd(reactor->timer->getFd(), EPOLLIN);
+        }
+        if(!initSocket_(reactor.get())) {
+            // 初始化服务器socket失败
+            isClose_ = true;
+        }
+        reactors_.push_back(std::move(reactor));
     }
 }
 
 WebServer::~WebServer() {
-    close(listenFd_);
     isClose_ = true;
+    for(auto &reactor : reactors_) {
+        if(reactor->thread.joinable()) {
+            reactor->thread.join();
+        }
+        if(reactor->listenFd >= 0 && !(listenOptions_.sharedListen && reactor->id > 0)) {
+            // 共用的监听套接字只由0号reactor关闭
+            close(reactor->listenFd);
+        }
+    }
+    Metrics::instance().clearProbes();
+    // 先执行完线程池中剩余的任务并回收工作线程：任务会访问连接、准入控制和限流器，须在这些成员析构之前结束
+    threadpool_.reset();
     free(srcDir_);
 }
 
+void WebServer::addProbes_() {
+    Metrics &metrics = Metrics::instance();
+    metrics.addProbe("connections", Metrics::GAUGE, "Open client connections.", 
+        [] { return HttpConn::userNum.load(); });
+    metrics.addProbe("pool_queued_tasks", Metrics::GAUGE, "Tasks waiting in the thread pool.", 
+        [this] { return threadpool_->pending(); });
+    metrics.addProbe("pool_queue_delay_seconds", Metrics::GAUGE, "Smoothed time tasks wait in the thread pool.", 
+        [this] { return admission_->queueDelayUS() * 1e-6; });
+    metrics.addProbe("admission_rejected_total", Metrics::COUNTER, "Connections and requests rejected with 503.", 
+        [this] { return admission_->rejected(); });
+    metrics.addProbe("ratelimit_rejected_total", Metrics::COUNTER, "Connections and requests rejected with 429.", 
+        [this] { return rateLimiter_->rejected(); });
+    metrics.addProbe("buffer_bytes_in_use", Metrics::GAUGE, "Bytes of pooled buffer blocks held by connections.", 
+        [] { return BufferPool::instance().bytesInUse(); });
+    metrics.addProbe("buffer_bytes_pooled", Metrics::GAUGE, "Bytes of free buffer blocks cached in the pool.", 
+        [] { return BufferPool::instance().bytesCached(); });
+    metrics.addProbe("slab_bytes", Metrics::GAUGE, "Bytes of connection slots and HttpConn objects.", [this] {
+        size_t bytes = 0;
+        for(const auto &reactor : reactors_) {
+            bytes += reactor->conns->bytes();
+        }
+        return bytes;
+    });
+    if(HttpConn::accessLog) {
+        metrics.addProbe("accesslog_written_total", Metrics::COUNTER, "Access log records written.", 
+            [this] { return accessLog_->written(); });
+        metrics.addProbe("accesslog_dropped_total", Metrics::COUNTER, "Access log records dropped because the writer fell behind.", 
+            [this] { return accessLog_->dropped(); });
+    }
+}
+
 void WebServer::initEventMode_(int trigMode) {
     listenEvent_ = EPOLLRDHUP;  // 监听事件：仅作初始化，无它用
-    connectionEvent_ = EPOLLRDHUP || EPOLLONESHOT;  // 连接事件：对端断开，设置oneshot
+    connectionEvent_ = EPOLLRDHUP | EPOLLONESHOT;  // 连接事件：对端断开，设置oneshot
     switch (trigMode)
     {
     case 0:
@@ -52,40 +139,94 @@ void WebServer::initEventMode_(int trigMode) {
     HttpConn::isET = (connectionEvent_ & EPOLLET);
 }
 
+uint32_t WebServer::listenEvents_() const {
+    if(listenOptions_.sharedListen) {
+        // 共用的监听套接字以EPOLLEXCLUSIVE注册，避免一个新连接唤醒所有reactor(EPOLLEXCLUSIVE不能与EPOLLRDHUP同用)
+        return (listenEvent_ & ~EPOLLRDHUP) | EPOLLIN | EPOLLEXCLUSIVE;
+    }
+    return listenEvent_ | EPOLLIN;
+}
+
 void WebServer::Start() {
-    int timeMS = -1;
     if(!isClose_) {
         std::cout << "====================";
         std::cout<< "HCsTinyWebServer Start!";
         std::cout << "====================" << std::endl;
     }
-    // Epoll一直监听事件是否就绪
+    // 1~N-1号reactor各自运行在独立线程中，0号reactor运行在主线程
+    for(size_t i = 1; i < reactors_.size(); i++) {
+        Reactor *reactor = reactors_[i].get();
+        reactor->thread = std::thread(&WebServer::eventLoop_, this, reactor);
+    }
+    eventLoop_(reactors_[0].get());
+    for(size_t i = 1; i < reactors_.size(); i++) {
+        if(reactors_[i]->thread.joinable()) {
+            reactors_[i]->thread.join();
+        }
+    }
+}
+
+std::string WebServer::memoryReport() const {
+    size_t slabBytes = 0;
+    for(const auto &reactor : reactors_) {
+        slabBytes += reactor->conns->bytes();
+    }
+    size_t bufferBytes = BufferPool::instance().bytesInUse();
+    size_t cachedBytes = BufferPool::instance().bytesCached();
+    int conns = HttpConn::userNum;
+    char report[256];
+    snprintf(report, sizeof(report), 
+        "connections: %d, slab: %zu bytes, buffers: %zu bytes in use, %zu bytes pooled, per connection: %zu bytes", 
+        conns, slabBytes, bufferBytes, cachedBytes, (slabBytes + bufferBytes) / (conns > 0 ? conns : 1));
+    return report;
+}
+
+void WebServer::eventLoop_(Reactor *reactor) {
+    current_ = reactor;
+    // 事件后端一直监听事件是否就绪
     while(!isClose_) {
+        handlePending_(reactor);
+        // 先声明将要阻塞再检查链表：投递者要么看到sleeping而唤醒，要么这里看到新投递的连接而不阻塞
+        reactor->sleeping.store(true, std::memory_order_seq_cst);
+        bool pending = reactor->pending.load(std::memory_order_seq_cst) != nullptr;
+        // 定时器到期由timerfd唤醒，无需计算超时时长
+        uint64_t waitStart = Metrics::now();
+        int eventCnt = reactor->poller->wait(pending ? 0 : -1);  // 返回就绪fd的数量
+        Metrics::recordSince(Metrics::POLL_WAIT, waitStart);
+        reactor->sleeping.store(false, std::memory_order_relaxed);
         if(timewaitMS_ > 0) {
-            // 清理过期连接，返回下一次处理的时长
-            timeMS = timer_->getNextHandle();
+            // 等待可能很久，更新缓存的时钟，本轮事件刷新定时器时使用
+            reactor->timer->tick();
         }
-        // 在计时器超时前唤醒epoll，判断是否有新事件到达
-        int eventCnt = epoll_->wait(timeMS);  // 返回就绪fd的数量
         for(int i = 0; i < eventCnt; i++) {
-            int fd = epoll_->getEventFd(i);   // 获取就绪的fd
-            uint32_t events = epoll_->getEvents(i); // 获取就绪fd对应的事件
+            uint64_t data = reactor->poller->getEventData(i);   // 获取就绪事件携带的数据：代数<<32|fd
+            int fd = ConnSlab::tokenFd(data);   // 获取就绪的fd
+            uint32_t events = reactor->poller->getEvents(i); // 获取就绪fd对应的事件
 
-            if(fd == listenFd_) {
+            if(fd == reactor->listenFd) {
                 // 监听
-                handleListen_();
-            } else if(events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                handleListen_(reactor);
+                continue;
+            }
+            if(fd == reactor->timer->getFd()) {
+                // 定时器到期，清理过期连接
+                reactor->timer->handleTimerEvent();
+                continue;
+            }
+            ConnSlab::Slot *slot = reactor->conns->find(data);
+            if(!slot) {
+                // fd已被新连接复用，丢弃旧连接残留的事件
+                continue;
+            }
+            if(events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
                 // 客户端关闭连接
-                assert(users_.count(fd) > 0);
-                closeConn_(&users_[fd]);
+                closeConn_(reactor, slot->conn);
             } else if(events & EPOLLIN) {
                 // 读事件
-                assert(users_.count(fd) > 0);
-                handleRead_(&users_[fd]);
+                handleRead_(reactor, slot->conn);
             } else if(events & EPOLLOUT) {
                 // 写事件
-                assert(users_.count(fd) > 0);
-                handleWrite_(&users_[fd]);
+                handleWrite_(reactor, slot->conn);
             } else {
                 // 其他事件
                 std::cout << "Unexpected event" << std::endl;
@@ -96,90 +237,243 @@ void WebServer::Start() {
 
 void WebServer::sendError_(int fd, const char* info) {
     assert(fd > 0);
-    int ret = send(fd, info, sizeof(info), 0);
+    send(fd, info, strlen(info), MSG_DONTWAIT | MSG_NOSIGNAL);
     close(fd);
 }
 
-void WebServer::closeConn_(HttpConn *client) {
+void WebServer::closeConn_(Reactor *reactor, HttpConn *client) {
     assert(client);
-    epoll_->rmFd(client->getFd());
+    if(current_ != reactor) {
+        // 工作线程中关闭：定时器只能由reactor修改，不论哪种事件后端都交回reactor关闭
+        handoff_(reactor, client, 0);
+        return;
+    }
+    int fd = client->getFd();
+    reactor->timer->del(&reactor->conns->at(fd).timer);   // 否则定时器到期时会再次关闭(fd可能已被复用)
+    reactor->poller->rmFd(fd);
     client->closeConn();
 }
 
-void WebServer::addClientConn_(int fd, sockaddr_in addr) {
+void WebServer::rejectConn_(Reactor *reactor, HttpConn *client) {
+    assert(client);
+    admission_->sendReject(client->getFd());
+    closeConn_(reactor, client);
+}
+
+void WebServer::addClientConn_(Reactor *reactor, int fd, sockaddr_in addr, const RateLimiter::ConnToken &limitToken) {
     assert(fd > 0);
-    users_[fd].initConn(fd, addr);
+    ConnSlab::Slot *slot = reactor->conns->open(fd);
+    if(!slot) {
+        // fd超出槽位表的容量
+        rateLimiter_->releaseConn(addr.sin_addr.s_addr, limitToken);
+        sendError_(fd, "Server busy!");
+        return;
+    }
+    HttpConn *client = slot->conn;
+    client->initConn(fd, addr, limitToken);
+    Metrics::addAccepted();
     if(timewaitMS_ > 0) {
+        if(!slot->timer.callbackFunc) {
+            // 槽位与HttpConn的对应关系固定，回调只需在首次使用时设置
+            slot->timer.callbackFunc = [this, reactor, client] { closeConn_(reactor, client); };
+        }
         // 添加定时器，到期关闭连接
-        timer_->addTimer(fd, timewaitMS_, std::bind(&WebServer::closeConn_, this, &users_[fd]));
+        reactor->timer->update(&slot->timer, timewaitMS_);
     }
-    epoll_->addFd(fd, EPOLLIN | connectionEvent_);
-    setFdNonblock(fd);
+    reactor->poller->addFd(fd, EPOLLIN | connectionEvent_, ConnSlab::token(fd, slot->gen));
 }
 
-void WebServer::handleListen_() {
+void WebServer::handleListen_(Reactor *reactor) {
     struct sockaddr_in addr;
-    socklen_t len = sizeof(addr);
-    do {
-        int fd = accept(listenFd_, (struct sockaddr*)&addr, &len);
-        if(fd <= 0) {
-            return;
-        } else if (HttpConn::userNum >= MAX_FD) {
-            sendError_(fd, "Server ist beshäftigt! Clients ist voll!");
+    RateLimiter::ConnToken limitToken;
+    // 每次唤醒都取空全连接队列：ET模式必须如此，LT模式也省去多余的唤醒
+    while(true) {
+        socklen_t len = sizeof(addr);
+        // 新连接直接设为非阻塞、exec时关闭，省去两次fcntl
+        int fd = accept4(reactor->listenFd, (struct sockaddr*)&addr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd < 0) {
+            if(errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            // EAGAIN：队列已空(共用监听套接字时也可能被其他reactor取走)
             return;
+        } else if (!admission_->admitConn(HttpConn::userNum)) {
+            // 连接数已达上限：回复503后立即关闭，不占用槽位
+            admission_->sendReject(fd);
+            close(fd);
+            continue;
+        } else if(!rateLimiter_->acquireConn(addr.sin_addr.s_addr, &limitToken)) {
+            // 该IP(或网段)的连接数已达上限
+            AdmissionControl::reply(fd, rateLimiter_->response());
+            close(fd);
+            continue;
         }
-        addClientConn_(fd, addr);
-    } while(listenFd_ & EPOLLET);
+        addClientConn_(reactor, fd, addr, limitToken);
+    }
 }
 
-void WebServer::handleWrite_(HttpConn *client) {
+void WebServer::handleWrite_(Reactor *reactor, HttpConn *client) {
     assert(client);
-    extentTime_(client);
-    threadpool_->enqueue(std::bind(&WebServer::onWrite_, this, client));    // 加入线程池任务队列
+    extentTime_(reactor, client);
+    if(runInline_) {
+        // 直接在reactor线程中发送
+        onWrite_(reactor, client);
+        return;
+    }
+    if(!post_(reactor, client, &WebServer::onWrite_)) {    // 加入线程池任务队列
+        // 线程池队列已满：响应已生成，直接在reactor线程中发送
+        onWrite_(reactor, client);
+    }
 }
 
-void WebServer::handleRead_(HttpConn *client) {
+void WebServer::handleRead_(Reactor *reactor, HttpConn *client) {
     assert(client);
-    extentTime_(client);
-    threadpool_->enqueue(std::bind(&WebServer::onRead_, this, client));
+    extentTime_(reactor, client);
+    if(runInline_) {
+        // 直接在reactor线程中读取、处理并发送
+        onRead_(reactor, client);
+        return;
+    }
+    if(!admission_->admitRequest(threadpool_->pending()) || !post_(reactor, client, &WebServer::onRead_)) {
+        // 过载或线程池队列已满：不再排队，直接拒绝
+        rejectConn_(reactor, client);
+    }
+}
+
+bool WebServer::post_(Reactor *reactor, HttpConn *client, void (WebServer::*task)(Reactor *, HttpConn *)) {
+    Metrics::addQueueDepth(threadpool_->pending());
+    uint64_t queued = Metrics::now();
+    return threadpool_->post([this, reactor, client, task, queued] {
+        uint64_t delay = Metrics::now() - queued;
+        Metrics::record(Metrics::QUEUE_WAIT, delay);
+        admission_->recordQueueDelay(delay / 1000);
+        (this->*task)(reactor, client);
+    });
 }
 
-void WebServer::extentTime_(HttpConn *client) {
+void WebServer::extentTime_(Reactor *reactor, HttpConn *client) {
     assert(client);
     if(timewaitMS_ > 0) {
-        timer_->update(client->getFd(), timewaitMS_);
+        reactor->timer->update(&reactor->conns->at(client->getFd()).timer, timewaitMS_);
+    }
+}
+
+void WebServer::rearm_(Reactor *reactor, HttpConn *client, uint32_t events) {
+    if(!inReactor_(reactor)) {
+        handoff_(reactor, client, connectionEvent_ | events);
+        return;
+    }
+    int fd = client->getFd();
+    reactor->poller->modFd(fd, connectionEvent_ | events, ConnSlab::token(fd, reactor->conns->at(fd).gen));
+}
+
+bool WebServer::inReactor_(Reactor *reactor) const {
+    return current_ == reactor || reactor->poller->threadSafe();
+}
+
+void WebServer::handoff_(Reactor *reactor, HttpConn *client, uint32_t events) {
+    // 连接此时只属于当前线程，槽位中的链表节点可以直接写入
+    ConnSlab::Slot *slot = &reactor->conns->at(client->getFd());
+    slot->pendingEvents = events;
+    ConnSlab::Slot *head = reactor->pending.load(std::memory_order_relaxed);
+    do {
+        slot->nextPending = head;
+    } while(!reactor->pending.compare_exchange_weak(head, slot, std::memory_order_seq_cst, std::memory_order_relaxed));
+    // reactor正在处理事件时会在本轮结束后取走链表，只有它阻塞在wait()中时才需要唤醒，且只由一个投递者唤醒
+    if(reactor->sleeping.load(std::memory_order_seq_cst) && reactor->sleeping.exchange(false, std::memory_order_relaxed)) {
+        reactor->poller->wakeup();
+    }
+}
+
+void WebServer::handlePending_(Reactor *reactor) {
+    if(!reactor->pending.load(std::memory_order_relaxed)) {
+        return;
+    }
+    ConnSlab::Slot *slot = reactor->pending.exchange(nullptr, std::memory_order_acquire);
+    while(slot) {
+        ConnSlab::Slot *next = slot->nextPending;   // 重新注册后连接可能立即交给其他线程，先取出后继
+        HttpConn *client = slot->conn;
+        int fd = client->getFd();
+        if(slot->pendingEvents == 0) {
+            closeConn_(reactor, client);
+        } else {
+            reactor->poller->modFd(fd, slot->pendingEvents, ConnSlab::token(fd, slot->gen));
+        }
+        slot = next;
     }
 }
 
 // 读函数：先接收再处理
-void WebServer::onRead_(HttpConn *client) {
+void WebServer::onRead_(Reactor *reactor, HttpConn *client) {
     assert(client);
     int ret = -1;
     int readError = 0;
     ret = client->readBuffer(&readError);
     if(ret <= 0 && (readError != EAGAIN || readError != EWOULDBLOCK)) {
         // 摒除无数据可读的错误号(EAGAIN or EWOULDBLOCK)
-        closeConn_(client);
+        closeConn_(reactor, client);
         return;
     }
-    onProcess_(client);
+    if(runInline_) {
+        onProcessInline_(reactor, client);
+    } else {
+        onProcess_(reactor, client);
+    }
 }
 
-/*  处理函数：判断读入的请求报文是否完整，决定继续监听读事件还是监听写事件
-    若请求报文不完整，继续读；请求报文完整，则根据请求内容生成相应的请求响应报文并发送
+/*  处理函数：判断读入的请求报文是否完整，决定继续监听读事件还是直接发送
+    若请求报文不完整，继续读；请求报文完整，则根据请求内容生成相应的请求响应报文并立即尝试发送，
+    发送缓冲区满时才监听写事件(省去一次重新注册，io_uring下即省去一次交回reactor)
 */
-void WebServer::onProcess_(HttpConn *client) {
+void WebServer::onProcess_(Reactor *reactor, HttpConn *client) {
     if(client->handleConn()) {
         // 请求报文完整
-        epoll_->modFd(client->getFd(), connectionEvent_ | EPOLLOUT);
+        onWrite_(reactor, client);
     } else {
         // 请求报文不完整，继续读
-        epoll_->modFd(client->getFd(), connectionEvent_ | EPOLLIN);
+        rearm_(reactor, client, EPOLLIN);
+    }
+}
+
+/*  运行至完成：在reactor线程中生成响应并立即尝试发送，省去两次线程切换和一次epoll_ctl
+    只有socket发送缓冲区满时才监听写事件；遇到较慢的请求(冷文件、POST等)才交给线程池
+*/
+void WebServer::onProcessInline_(Reactor *reactor, HttpConn *client) {
+    while(true) {
+        if(!client->handleConn(true)) {
+            if(client->isDeferred()) {
+                // 交给工作线程处理，处理完后由其监听写事件；过载或线程池队列已满时不再排队，直接拒绝
+                if(!admission_->admitRequest(threadpool_->pending()) || !post_(reactor, client, &WebServer::onProcess_)) {
+                    rejectConn_(reactor, client);
+                }
+            } else {
+                // 请求报文不完整，继续读
+                rearm_(reactor, client, EPOLLIN);
+            }
+            return;
+        }
+        int writeError = 0;
+        ssize_t ret = client->writeBuffer(&writeError);
+        if(client->writeBytes() > 0) {
+            if(ret > 0 || writeError == EAGAIN || writeError == EWOULDBLOCK) {
+                // 发送缓冲区已满，等待写事件
+                rearm_(reactor, client, EPOLLOUT);
+            } else {
+                // 发送失败
+                closeConn_(reactor, client);
+            }
+            return;
+        }
+        if(!client->isKeepAlive()) {
+            closeConn_(reactor, client);
+            return;
+        }
+        // 本批响应已全部发出，继续处理缓冲区中剩余的请求
     }
 }
 
 // 写函数：发送响应报文
-void WebServer::onWrite_(HttpConn *client) {
+void WebServer::onWrite_(Reactor *reactor, HttpConn *client) {
     assert(client);
     int ret = -1;
     int writeError = 0;
@@ -187,23 +481,37 @@ void WebServer::onWrite_(HttpConn *client) {
     if(client->writeBytes() == 0) {
         // 数据已发送完毕
         if(client->isKeepAlive()) {
-            onProcess_(client);
+            if(runInline_) {
+                onProcessInline_(reactor, client);
+            } else {
+                onProcess_(reactor, client);
+            }
             return;
         }
+    } else if(ret > 0) {
+        // 本次写入已达上限但数据未发送完毕，继续监听写事件
+        rearm_(reactor, client, EPOLLOUT);
+        return;
     } else if(ret < 0) {
         // 发送失败
         if(writeError == EAGAIN || writeError == EWOULDBLOCK) {
             // 缓存已满导致发送失败，继续监听写事件
-            epoll_->modFd(client->getFd(), connectionEvent_ | EPOLLOUT);
+            rearm_(reactor, client, EPOLLOUT);
             return;
         }
     }
     // 其他原因导致发送失败，关闭连接
-    closeConn_(client);
+    closeConn_(reactor, client);
 }
 
-// 创建并初始化socket：设置socket属性，绑定端口，向epoll注册事件
-bool WebServer::initSocket_() {
+// 创建并初始化socket：设置socket属性，绑定端口，向事件后端注册事件
+bool WebServer::initSocket_(Reactor *reactor) {
+    if(listenOptions_.sharedListen && reactor->id > 0) {
+        // 共用0号reactor的监听套接字，只需注册
+        reactor->listenFd = reactors_[0]->listenFd;
+        return reactor->listenFd >= 0 && reactor->poller->addFd(reactor->listenFd, listenEvents_());
+    }
+
     struct sockaddr_in addr;
     if(port_ < 1024 || port_ > 65535) {
         std::cout << "Port error! It should be between 1024-65535!" << "\n"; 
@@ -213,63 +521,63 @@ bool WebServer::initSocket_() {
     addr.sin_port = htons(port_);
     addr.sin_addr.s_addr = INADDR_ANY;
 
-    struct linger optLinger;
+    struct linger optLinger = {0};
     if(isLinger_) {
         // 延迟关闭：直到剩余数据发送完毕or超时
         optLinger.l_onoff = 1;
         optLinger.l_linger = 10;  // 最多等待10s接收客户端关闭确认
     }
 
-    // 创建套接字
-    listenFd_ = socket(PF_INET, SOCK_STREAM, 0);
-    if(listenFd_ < 0) {
+    // 创建非阻塞的套接字(但是延时关闭还是会导致close()阻塞)
+    reactor->listenFd = socket(PF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(reactor->listenFd < 0) {
         return false;
     }
 
     // 设置延迟关闭
-    int ret1 = setsockopt(listenFd_, SOL_SOCKET, SO_LINGER, &optLinger, sizeof(optLinger));
+    int ret1 = setsockopt(reactor->listenFd, SOL_SOCKET, SO_LINGER, &optLinger, sizeof(optLinger));
     if(ret1 < 0) {
-        close(listenFd_);
+        close(reactor->listenFd);
         return false;
     }
 
-    // 端口复用
+    // 端口复用：多个reactor的监听套接字绑定同一端口，由内核做负载均衡
     int optval = 1;
-    int ret2 = setsockopt(listenFd_, SOL_SOCKET, SO_REUSEPORT, (const void*)&optval, sizeof(optval));
+    int ret2 = setsockopt(reactor->listenFd, SOL_SOCKET, SO_REUSEPORT, (const void*)&optval, sizeof(optval));
     if(ret2 < 0) {
-        close(listenFd_);
+        close(reactor->listenFd);
         return false;
     }
 
+    // 收到客户端的数据才唤醒accept，只连接不发请求的客户端不占用连接
+    if(listenOptions_.deferAcceptSec > 0) {
+        setsockopt(reactor->listenFd, IPPROTO_TCP, TCP_DEFER_ACCEPT, 
+            &listenOptions_.deferAcceptSec, sizeof(listenOptions_.deferAcceptSec));
+    }
+    // TCP Fast Open：重复访问的客户端在SYN中携带请求，省去一个往返(内核不支持时忽略)
+    if(listenOptions_.fastOpenQueue > 0) {
+        setsockopt(reactor->listenFd, IPPROTO_TCP, TCP_FASTOPEN, 
+            &listenOptions_.fastOpenQueue, sizeof(listenOptions_.fastOpenQueue));
+    }
+
     // 绑定本地IP和port
-    int ret3 = bind(listenFd_, (struct sockaddr*)&addr, sizeof(addr));
+    int ret3 = bind(reactor->listenFd, (struct sockaddr*)&addr, sizeof(addr));
     if(ret3 < 0) {
-        close(listenFd_);
+        close(reactor->listenFd);
         return false;
     }
 
-    // 设置监听，指定请求队列大小为6
-    int ret4 = listen(listenFd_, 6);
+    // 设置监听，指定全连接队列的长度
+    int ret4 = listen(reactor->listenFd, listenOptions_.backlog > 0 ? listenOptions_.backlog : SOMAXCONN);
     if(ret4 < 0) {
-        close(listenFd_);
+        close(reactor->listenFd);
         return false;
     }
 
-    // 在内核注册Epoll实例，添加监听套接字
-    int ret5 = epoll_->addFd(listenFd_, listenEvent_ | EPOLLIN);
-    if(ret5 < 0) {
-        close(listenFd_);
+    // 向事件后端添加监听套接字
+    if(!reactor->poller->addFd(reactor->listenFd, listenEvents_())) {
+        close(reactor->listenFd);
         return false;
     }
-
-    // 设置监听套接字非阻塞(但是延时关闭还是会导致close()阻塞)
-    setFdNonblock(listenFd_);
     return true;
 }
-
-int WebServer::setFdNonblock(int fd) {
-    assert(fd > 0);
-    int oldFlag = fcntl(fd, F_GETFL, 0);
-    int newFlag = oldFlag | O_NONBLOCK;
-    return fcntl(fd, F_SETFL, newFlag);
-}
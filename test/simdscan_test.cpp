@@ -0,0 +1,152 @@
+#include "../include/simdscan.hpp"
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/*  SimdScan的一致性测试：SSE2/AVX2实现与标量实现在同一输入上的结果必须相同
+    输入为随机字节(偏向\r、\n、':'、空格、控制字符和>=0x80的字节)，覆盖奇数长度、不足16/32字节的尾部和不同的起始对齐
+    数据紧贴在不可访问的保护页之前，越界读会直接崩溃
+    CPU不支持的实现在运行时跳过
+*/
+
+static int failures = 0;
+
+// 数据区末尾紧接一个PROT_NONE页
+class GuardedBuffer {
+public:
+    GuardedBuffer() {
+        page_ = sysconf(_SC_PAGESIZE);
+        base_ = static_cast<char *>(mmap(nullptr, page_ * 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        if(base_ == MAP_FAILED || mprotect(base_ + page_, page_, PROT_NONE) != 0) {
+            perror("mmap");
+            _exit(2);
+        }
+    }
+    ~GuardedBuffer() { munmap(base_, page_ * 2); };
+
+    // 放置长度为len的数据，结尾紧贴保护页
+    char *place(const std::vector<char> &data) {
+        char *begin = base_ + page_ - data.size();
+        if(!data.empty()) {
+            memcpy(begin, data.data(), data.size());
+        }
+        return begin;
+    }
+    size_t capacity() const { return page_; };
+
+private:
+    char *base_;
+    size_t page_;
+};
+
+static void check(const char *impl, const char *func, const std::vector<char> &data, const char *begin,
+    const char *expect, const char *got) {
+    if(expect == got) {
+        return;
+    }
+    if(failures++ < 20) {
+        fprintf(stderr, "FAIL %s %s len=%zu: expected offset %td, got %td\n", impl, func, data.size(),
+            expect - begin, got - begin);
+    }
+}
+
+static void compare(const SimdScan::Impl &impl, GuardedBuffer &buffer, const std::vector<char> &data, char ch) {
+    const SimdScan::Impl &ref = SimdScan::scalar();
+    const char *begin = buffer.place(data);
+    const char *end = begin + data.size();
+    check(impl.name, "findCRLF", data, begin, ref.findCRLF(begin, end), impl.findCRLF(begin, end));
+    check(impl.name, "findChar", data, begin, ref.findChar(begin, end, ch), impl.findChar(begin, end, ch));
+    check(impl.name, "findCtl", data, begin, ref.findCtl(begin, end), impl.findCtl(begin, end));
+}
+
+// 随机字节：多数是普通可见字符，目标字符出现得足够稀疏，使命中位置分布在块内和尾部
+static char randomByte(std::mt19937 &rng) {
+    static const char SPECIAL[] = {'\r', '\n', ':', ' ', '\t', '\0', 0x1f, 0x7f};
+    unsigned r = rng() % 64;
+    if(r == 0) {
+        return SPECIAL[rng() % sizeof(SPECIAL)];
+    }
+    if(r < 16) {
+        return static_cast<char>(0x80 + rng() % 0x80); // 有符号比较时为负数
+    }
+    return static_cast<char>(0x21 + rng() % (0x7f - 0x21));
+}
+
+static void testImpl(const SimdScan::Impl &impl) {
+    GuardedBuffer buffer;
+    std::mt19937 rng(20240611);
+    std::vector<char> data;
+
+    // 随机内容，长度0~200逐一覆盖
+    for(size_t len = 0; len <= 200; len++) {
+        for(int round = 0; round < 200; round++) {
+            data.resize(len);
+            for(char &c : data) {
+                c = randomByte(rng);
+            }
+            compare(impl, buffer, data, ':');
+        }
+    }
+
+    // 全为>=0x80的字节(不应被findCtl当作控制字符)，在随机位置放一个目标
+    for(size_t len = 1; len <= 100; len++) {
+        for(size_t pos = 0; pos <= len; pos++) {
+            data.assign(len, static_cast<char>(0x80 | (pos & 0x7f)));
+            if(pos < len) {
+                data[pos] = ' ';
+            }
+            compare(impl, buffer, data, ' ');
+        }
+    }
+
+    // \r在最后一个字节(没有\n)，以及\r\n跨越16/32字节块的边界
+    for(size_t len = 1; len <= 100; len++) {
+        data.assign(len, 'a');
+        data[len - 1] = '\r';
+        compare(impl, buffer, data, '\r');
+        for(size_t pos = 0; pos + 1 < len; pos++) {
+            data.assign(len, 'a');
+            data[pos] = '\r';
+            data[pos + 1] = '\n';
+            compare(impl, buffer, data, '\n');
+        }
+    }
+
+    // \r\r\n：第一个\r后不是\n
+    for(size_t len = 3; len <= 70; len++) {
+        data.assign(len, 'x');
+        data[len - 3] = '\r';
+        data[len - 2] = '\r';
+        data[len - 1] = '\n';
+        compare(impl, buffer, data, 'x');
+    }
+
+    // 长缓冲区(接近一页)，目标在尾部
+    data.assign(buffer.capacity() - 1, 'b');
+    data[data.size() - 2] = '\r';
+    data[data.size() - 1] = '\n';
+    compare(impl, buffer, data, 'b');
+}
+
+int main() {
+    std::vector<const SimdScan::Impl *> impls = {SimdScan::sse2(), SimdScan::avx2()};
+    const char *names[] = {"sse2", "avx2"};
+    for(size_t i = 0; i < impls.size(); i++) {
+        if(!impls[i]) {
+            printf("skip %s: not supported by this CPU\n", names[i]);
+            continue;
+        }
+        testImpl(*impls[i]);
+        printf("checked %s against scalar\n", names[i]);
+    }
+    if(failures > 0) {
+        fprintf(stderr, "%d mismatches\n", failures);
+        return 1;
+    }
+    printf("active: %s\n", SimdScan::active().name);
+    return 0;
+}
\ No newline at end of file